@@ -18,6 +18,8 @@
 // Fonts
 #define FONT_UI    "C:/Windows/Fonts/segoeui.ttf"
 #define FONT_MONO  "C:/Windows/Fonts/consola.ttf"
+#define FONT_SYM   "C:/Windows/Fonts/seguisym.ttf"
+#define FONT_CJK   "C:/Windows/Fonts/msyh.ttc"
 
 // Chart parameters
 #define MAX_BARS 20            // Max number of bars
@@ -109,25 +111,23 @@ void save_chart_ppm(fs_Context *ctx) {
     FILE *fp = fopen("chart.ppm", "wb");
     assert(fp);
 
-    unsigned char *buffer = (unsigned char *)calloc(ctx->width * ctx->height * 3, sizeof(unsigned char));
-    glReadBuffer(GL_FRONT);
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadPixels(0, 0, ctx->width, ctx->height, GL_RGB, GL_UNSIGNED_BYTE, buffer);
+    unsigned char *buffer = (unsigned char *)calloc(ctx->fb_width * ctx->fb_height * 3, sizeof(unsigned char));
+    fs_read_pixels(ctx, buffer);
 
-    int rowSize = ctx->width * 3;
+    int rowSize = ctx->fb_width * 3;
     unsigned char* tempRow = malloc(rowSize);
     // Flip image - swap row y with row (height - 1 - y)
-    for (int y = 0; y < ctx->height / 2; ++y) {
+    for (int y = 0; y < ctx->fb_height / 2; ++y) {
         memcpy(tempRow, buffer + y * rowSize, rowSize);
-        memcpy(buffer + y * rowSize, buffer + (ctx->height - 1 - y) * rowSize, rowSize);
-        memcpy(buffer + (ctx->height - 1 - y) * rowSize, tempRow, rowSize);
+        memcpy(buffer + y * rowSize, buffer + (ctx->fb_height - 1 - y) * rowSize, rowSize);
+        memcpy(buffer + (ctx->fb_height - 1 - y) * rowSize, tempRow, rowSize);
     }
     free(tempRow);
 
     fprintf(fp, "P6\n"); // P6 format
-    fprintf(fp, "%d %d\n", ctx->width, ctx->height); // image size
+    fprintf(fp, "%d %d\n", ctx->fb_width, ctx->fb_height); // image size
     fprintf(fp, "%d\n", 255); // rgb component depth = 255
-	fwrite(buffer, sizeof(unsigned char), ctx->width * ctx->height * 3, fp);
+	fwrite(buffer, sizeof(unsigned char), ctx->fb_width * ctx->fb_height * 3, fp);
 
     fclose(fp);
     free(buffer);
@@ -167,7 +167,8 @@ void screen_1(fs_Context *ctx, ChartData *data, int flag)
     vec4 col;
     int i, prev_val = 0;
 
-    // Draw chart
+    // Draw chart - static, rendered once into a layer
+    fs_begin_layer(ctx, NO_SIGNAL);
     for (i = 0; i < data->data_num - 1; ++i)
     {
         if (data->elem[i].value < 0)
@@ -191,7 +192,7 @@ void screen_1(fs_Context *ctx, ChartData *data, int flag)
 
         xpos = x + w / 2.0;
         ypos = y + h / 2.0 + ctx->fonts[MONO].line_height / 2.0;
-        fs_add_text(ctx, (vec2){xpos, ypos}, data->elem[i].item, MONO, (vec4)WHITE, ALIGN_CENTER);
+        fs_add_paragraph(ctx, (vec4){x, ypos - ctx->fonts[MONO].line_height, w, ctx->fonts[MONO].line_height}, data->elem[i].item, MONO, (vec4)WHITE, ALIGN_CENTER, TEXT_ELLIPSIS);
         sprintf(buf, "%d", data->elem[i].value);
         fs_add_text(ctx, (vec2){xpos, ypos + ctx->fonts[MONO].line_height}, buf, MONO, (vec4)WHITE, ALIGN_CENTER);
         prev_val -= data->elem[i].value;
@@ -203,7 +204,7 @@ void screen_1(fs_Context *ctx, ChartData *data, int flag)
     xpos = x + w / 2.0;
     ypos = data->baseline + h / 2.0 + ctx->fonts[MONO].line_height / 2.0;
     fs_add_rect(ctx, (vec4){x, data->baseline, w, h}, (vec4)CYAN);
-    fs_add_text(ctx, (vec2){xpos, ypos}, data->elem[i].item, MONO, (vec4)WHITE, ALIGN_CENTER);
+    fs_add_paragraph(ctx, (vec4){x, ypos - ctx->fonts[MONO].line_height, w, ctx->fonts[MONO].line_height}, data->elem[i].item, MONO, (vec4)WHITE, ALIGN_CENTER, TEXT_ELLIPSIS);
     sprintf(buf, "%d", -prev_val);
     fs_add_text(ctx, (vec2){xpos, ypos + ctx->fonts[MONO].line_height}, buf, MONO, (vec4)WHITE, ALIGN_CENTER);
 
@@ -213,6 +214,7 @@ void screen_1(fs_Context *ctx, ChartData *data, int flag)
 
     // Title
     fs_add_text(ctx, (vec2){WIDTH / 2.0, 70}, data->title, BIG, (vec4)WHITE, ALIGN_CENTER);
+    fs_end_layer(ctx);
 
     // Add hover area
     fs_add_area(ctx, (vec4){0, 0, 150, 50}, area_baseline_screen_1);
@@ -255,8 +257,9 @@ void dashboard(fs_Context *ctx, ChartData *data)
                 data->elem[i].value = atof(fs_get_inputbox_content(ctx, i * 2 + 2));
             }
             chart_metrics(data);
-            // Initialize screen_1
+            // Initialize screen_1 - chart data changed, rebuild it
             fs_change_screen(ctx, 1);
+            fs_clear_screen(ctx);
             screen_1(ctx, data, 1);
             char buf[32];
             sprintf(buf, "%d", data->baseline);
@@ -274,9 +277,8 @@ void dashboard(fs_Context *ctx, ChartData *data)
             screen_1(ctx, data, 0);
             fs_render_ui(ctx);
             save_chart_ppm(ctx);
-            // Go back
+            // Go back - screen_0 is retained, only the baseline may have changed
             fs_change_screen(ctx, 0);
-            screen_0(ctx, data);
             char buf[32];
             sprintf(buf, "%d", data->baseline);
             fs_set_inputbox_content(ctx, 0, buf);
@@ -295,6 +297,26 @@ void dashboard(fs_Context *ctx, ChartData *data)
     }
 }
 
+// Build frames of the current screen without presenting them - text runs are measured and shaped only in the first frame
+void bench_frames(fs_Context *ctx, int frames)
+{
+    fs_build_frame(ctx, &ctx->frames[0]); // Warm up: runs, fallback glyphs
+    unsigned long misses = ctx->runs.misses;
+    double start = glfwGetTime();
+    for (int i = 0; i < frames; ++i)
+    {
+        fs_build_frame(ctx, &ctx->frames[0]);
+    }
+    double elapsed = glfwGetTime() - start;
+
+    printf("Bench: %d frames, %.3f ms per frame, %lu runs measured after the first frame\n", frames, elapsed * 1000.0 / frames,
+           ctx->runs.misses - misses);
+#ifdef FS_USE_HARFBUZZ
+    printf("Bench: %lu runs shaped for %d frames\n", ctx->runs.shaped, frames + 1);
+#endif
+    fs_run_cache_report(ctx);
+}
+
 int main(int argc, char **argv)
 {
     // Default UI colors
@@ -310,15 +332,20 @@ int main(int argc, char **argv)
     };
 
     fs_Context *ctx = calloc(1, sizeof(fs_Context));
+    // chart --replay session.fsir runs a recorded session headless, --record saves one, --bench 1000 times frame building
+    if (argc == 3 && strcmp(argv[1], "--replay") == 0 && !fs_replay_load(ctx, argv[2]))
+    {
+        return EXIT_FAILURE;
+    }
     fs_init_context(ctx, "Waterfall chart", WIDTH, HEIGHT, fs_colors);
 
     fs_Fonts fonts[FONTS_NUM] = {
-        {   .path = FONT_UI, .size = 25, .gamma = 1.5}, // Medium
-        {   .path = FONT_UI, .size = 50, .gamma = 1.5}, // Big
-        {   .path = FONT_UI, .size = 16, .gamma = 1.5}, // Small
-        { .path = FONT_MONO, .size = 16, .gamma = 1.5}, // Mono
-        { .path = FONT_MONO, .size = 15, .gamma = 1.5}, // Inputbox
-        { .path = FONT_MONO, .size = 14, .gamma = 1.5}, // Hover
+        {   .path = FONT_UI, .size = 25, .gamma = 1.5, .fallback = {FONT_SYM, FONT_CJK}}, // Medium
+        {   .path = FONT_UI, .size = 50, .gamma = 1.5, .grayscale = 1, .fallback = {FONT_SYM, FONT_CJK}}, // Big
+        {   .path = FONT_UI, .size = 16, .gamma = 1.5, .fallback = {FONT_SYM, FONT_CJK}}, // Small
+        { .path = FONT_MONO, .size = 16, .gamma = 1.5, .phases = 3, .fallback = {FONT_UI, FONT_CJK}}, // Mono
+        { .path = FONT_MONO, .size = 15, .gamma = 1.5, .fallback = {FONT_UI, FONT_CJK}}, // Inputbox
+        { .path = FONT_MONO, .size = 14, .gamma = 1.5, .fallback = {FONT_UI, FONT_CJK}}, // Hover
     };
 
     fs_init_fonts(ctx, fonts);
@@ -337,6 +364,17 @@ int main(int argc, char **argv)
         fs_set_inputbox_content(ctx, i * 2 + 2, buf);
     }
 
+    if (argc == 3 && strcmp(argv[1], "--record") == 0)
+    {
+        fs_record_start(ctx, argv[2]);
+    }
+    if (argc == 3 && strcmp(argv[1], "--bench") == 0)
+    {
+        bench_frames(ctx, atoi(argv[2]) > 0 ? atoi(argv[2]) : 1000);
+        fs_exit(ctx);
+        return EXIT_SUCCESS;
+    }
+
     while (!glfwWindowShouldClose(ctx->window))
     {
         dashboard(ctx, &data);
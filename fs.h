@@ -2,6 +2,10 @@
 #define FS_HEADER_
 
 #include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include <glad/glad.h>
@@ -10,32 +14,139 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+// Define FS_RENDER_THREAD to build frames on the calling thread and render them on a GL thread
+// Define FS_LAYOUT_THREADS as number of worker threads to lay out big screens in parallel
+#if defined(FS_RENDER_THREAD) || defined(FS_LAYOUT_THREADS)
+#include <stdatomic.h>
+#include <threads.h>
+#define FS_THREADS // Atlas rebuilds bake on a background thread too
+#endif
+
+// Define FS_TEXT_REFERENCE for the original text shader - three fetches and pow() per fragment, for golden images
+// Define FS_TEXT_DUAL_SOURCE to blend subpixel coverage per color channel
+#if defined(FS_TEXT_REFERENCE) && defined(FS_TEXT_DUAL_SOURCE)
+#undef FS_TEXT_DUAL_SOURCE // Reference blends with one alpha
+#endif
+
+// Define FS_USE_HARFBUZZ to shape text runs with HarfBuzz - GPOS kerning, ligatures and complex scripts
+#ifdef FS_USE_HARFBUZZ
+#include <hb.h>
+#include <hb-ft.h>
+#endif
+
+// SIMD lanes for geometry tests - define FS_NO_SIMD to force the scalar path
+#if !defined(FS_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define FS_SIMD_WIDTH 8
+#elif !defined(FS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define FS_SIMD_WIDTH 4
+#else
+#define FS_SIMD_WIDTH 1
+#endif
+
+// Bytes per text measurement step - AVX2 gathers advances and kerning, SSE2 builds pair indices only
+#if FS_SIMD_WIDTH > 1 && defined(__AVX2__)
+#define FS_TEXT_SIMD 32
+#elif FS_SIMD_WIDTH > 1
+#define FS_TEXT_SIMD 16
+#else
+#define FS_TEXT_SIMD 0
+#endif
 
 #define NO_SIGNAL         (-1)  // No signal
-#define MAX_INSTANCES     8000  // Max glyphs to render
 #define MAX_LEN           1023  // Max length of text fields
 #define MAX_WIDTH         4096  // Max texture width
 #define PADDING           5     // Padding in pixels
-#define SCREEN_NUM        6     // Number of screens
-#define VEC_INIT_CAP      8     // Initial vector size
+#define FRAMES_NUM        3     // Frame command lists - triple buffering
+#define FRAME_FRESH       4     // Published frame not rendered yet flag
+#define LAYERS_NUM        4     // Static layers per screen
+#define VEC_INIT_CAP      8     // Initial geometry size
+#define VEC_INLINE_CAP    16    // Items stored inline before a vector moves to heap
+#define ARENA_BLOCK       65536 // Arena block size in bytes
+#define GEOM_ALIGN        8     // Geometry capacity multiple - widest SIMD lane count
 
 #define FONTS_NUM         6     // Number of fonts
 #define GLYPHS_NUM        95    // ASCII glyphs (126 - 32 + 1)
+#define GLYPHS_EXTRA      128   // Glyphs rasterized on demand per font - shaped and fallback glyphs
+#define GLYPH_MAP         512   // Glyph index to slot map entries - power of two
+#define COVER_MAP         1024  // Codepoint to slot map entries - power of two
+#define FALLBACK_NUM      3     // Fallback faces per font
+#define KERN_DIM          128   // Kerning pair table side - ASCII
+#define FONT_DPI          144   // Font resolution at content scale 1
+#define PALETTE_NUM       256   // Text colors per frame
+#define RUN_CACHE_SIZE    1024  // Cached text runs, least recently used is evicted
+#define RUN_CACHE_BUCKETS 2048  // Run cache hash buckets - power of two
+#define HOVER_WIDTH       480   // Hover text wraps at this width
+#define INPUT_QUEUE       256   // Input events buffered between drains - power of two
 
 #define CLICK_LO          0.02  // Double click LO time
 #define CLICK_HI          0.20  // Double click HI time
-#define ACC_Y             10.0  // Vertical acceleration
-#define LIMIT             5.0f  // Duration of scroll
-#define SLOWDOWN          0.98  // Slowdown factor
+#define ACC_Y             10.0  // Kinetic scroll step per wheel notch
+#define SCROLL_SPEED      600.0 // Kinetic scroll speed per wheel notch, offset units per second
+#define SCROLL_STOP       300.0 // Kinetic scroll stops below this speed
+#define SCROLL_DECAY      0.825 // Kinetic scroll velocity time constant in seconds
+#define SCROLL_STEP       240.0 // Smooth scroll distance per wheel notch
+#define SCROLL_EASE       0.08  // Smooth scroll time constant in seconds
+#define TARGET_FPS        60.0  // Redraw rate cap, 0 for no cap
+#define SWAP_INTERVAL     1     // Buffer swap interval (vsync)
+
+#ifndef FS_LAYOUT_PARALLEL
+#define FS_LAYOUT_PARALLEL 8192 // Glyphs per font above which layout runs on FS_LAYOUT_THREADS
+#endif
+#define LAYOUT_CHUNK      1024  // Glyphs per layout task
+
+#define FS_PROFILE_EVENTS 65536 // Trace events buffered before flushing to file
+#ifndef FS_PROFILE_FILE
+#define FS_PROFILE_FILE   "fs_trace.json"
+#endif
+
+// Linked programs are cached as FS_SHADER_CACHE<key>.bin - define FS_NO_SHADER_CACHE to always compile
+#ifndef FS_SHADER_CACHE
+#define FS_SHADER_CACHE   "fs_shader_"
+#endif
+#define PROGRAM_MAGIC     0x42505346 // "FSPB" program binary cache file
+#define RECORD_MAGIC      0x52495346 // "FSIR" input recording file
+#define RECORD_RESIZE     INPUT_KINDS       // Recorded window resize, applied directly
+#define RECORD_END        (INPUT_KINDS + 1) // Last record, final frame hash follows
+
+// Program binaries need GL 4.1 or ARB_get_program_binary in the glad loader
+#if !defined(FS_NO_SHADER_CACHE) && (defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary))
+#define FS_PROGRAM_BINARY
+#endif
 
 #define ACTIVE_BOX        ctx->inputbox.boxes[ctx->screen].selected
 #define BUTTON_CLICKED    ctx->buttons.clicked
 #define COMMITED_BOX      ctx->inputbox.boxes[ctx->screen].commited
 #define SCREEN            ctx->screen
 
+#define FS_STR_(x)        #x
+#define FS_STR(x)         FS_STR_(x)
+
+// Uniforms of the current view, shared by all programs - matches fs_View
+#define FS_VIEW_BLOCK     "layout(std140) uniform View { mat4 transform; vec2 res_win; float view_scale; };\n"
+
+// Profiling scopes - define FS_PROFILE to write a Chrome trace-event file (chrome://tracing, Perfetto)
+#ifdef FS_PROFILE
+#define FS_PROFILE_BEGIN(name) fs_profile_event(name, 'B')
+#define FS_PROFILE_END(name)   fs_profile_event(name, 'E')
+#define FS_PROFILED(fn)        fn##_profiled
+#else
+#define FS_PROFILE_BEGIN(name)
+#define FS_PROFILE_END(name)
+#define FS_PROFILED(fn)        fn
+#endif
+
 enum { TXT, NUM };
 typedef enum Align { ALIGN_LEFT, ALIGN_CENTER, ALIGN_RIGHT }   Align;
+typedef enum { SCROLL_KINETIC, SCROLL_SMOOTH }                 ScrollMode;
 typedef enum { MEDIUM, BIG, SMALL, MONO, BOX, HOVER }          FontType;
+typedef enum { MEM_FONTS, MEM_RUNS, MEM_ELEMENTS, MEM_FRAMES, MEM_LAYERS, MEM_SHADERS, MEM_NUM } MemoryKind;
+typedef enum { INPUT_CHAR, INPUT_KEY, INPUT_BUTTON, INPUT_SCROLL, INPUT_CURSOR, INPUT_KINDS } InputKind;
+enum { TEXT_WRAP = 1, TEXT_ELLIPSIS = 2 }; // fs_add_paragraph flags
+typedef enum { UNIFORM_RES_ATLAS, UNIFORM_GAMMA, UNIFORM_METRICS_BASE, UNIFORM_SCALE, UNIFORM_ORIGIN, UNIFORM_ALIGNED, UNIFORM_RECT, UNIFORMS_NUM } UniformKind;
 
 typedef float vec2[2];
 typedef float vec3[3];
@@ -47,25 +158,51 @@ typedef void (*FnPtr)(struct fs_context *); // Function pointer type
 
 typedef struct {
     char path[64];  // Font path
+    char fallback[FALLBACK_NUM][64]; // Fonts for characters the font misses, in order - opened on first use
     float size;     // Font size
     float gamma;    // Gamma correction
+    int phases;     // Subpixel glyph positions per pixel, 3 or 4 - 0 or 1 snaps glyphs to whole pixels
+    int grayscale;  // Grayscale antialiasing instead of LCD subpixels, atlas is GL_R8 - a third of the memory
 } fs_Fonts;
 
+// Typed vector keeping the first N items inline, functions generated by FS_VECTOR_FUNCS
+#define FS_VECTOR(name, T, N)                                        \
+    typedef struct {                                                 \
+        T *heap;          /* Heap items once grown past N or NULL */ \
+        size_t capacity;  /* Heap capacity */                        \
+        size_t size;                                                 \
+        T small[N];       /* Inline items */                         \
+    } name
+
+// Hot element geometry as struct of arrays, capacity padded to GEOM_ALIGN for SIMD loads
 typedef struct {
+    float *x, *y, *w, *h;
     size_t capacity;
     size_t size;
-    size_t item_size;
-    void *items;
-} fs_Vector;
+} fs_Geometry;
+
+typedef struct fs_arena_block {
+    struct fs_arena_block *next;
+    size_t capacity;
+    size_t used;
+    char data[];
+} fs_ArenaBlock;
+
+typedef struct {
+    fs_ArenaBlock *first;
+    fs_ArenaBlock *current;
+} fs_Arena;
 
 typedef struct {
-    vec4 pos;       // Area background x,y,w,h
     vec4 text_pos;  // Text background position x,y,w,h
     FnPtr func;     // Function call
 } fs_Area;
 
+FS_VECTOR(fs_AreaVector, fs_Area, VEC_INLINE_CAP);
+
 typedef struct {
-    fs_Vector *area;
+    fs_Geometry geom; // Area positions x,y,w,h
+    fs_AreaVector area;
     vec4 col;         // Area background color
     int active;       // Index of active area
     int count;        // Number of areas added to the current screen
@@ -81,46 +218,143 @@ typedef struct {
     GLfloat offset_y;
 } fs_Glyph;
 
+// Glyph rasterized on demand, one per phase
+typedef struct {
+    int slot;                 // Metrics texel
+    int x, y;                 // Bitmap position in atlas
+    int width, height;        // Bitmap size in atlas pixels
+    GLfloat metrics[8];       // Coordinates and metrics texels of the slot
+} fs_GlyphPatch;
+
+// Glyphs rasterized on demand into the extra region of one atlas generation. Append only - a frame records
+// how many its layout used and the GL side uploads new ones up to that count.
+typedef struct {
+    int y0;                   // First atlas row of the extra region
+    int x, y, shelf;          // Next position in region and height of current shelf, main thread
+    int num;                  // Patches written, main thread
+#ifndef FS_TEXT_REFERENCE
+    unsigned char gamma_lut[256];
+#endif
+    unsigned char *pixels;    // Extra region, tex_width wide - channels bytes per pixel
+    fs_GlyphPatch patches[];  // GLYPHS_EXTRA * phases
+} fs_GlyphLog;
+
+// Face and glyph index, or codepoint, to atlas slot - open addressing
+typedef struct {
+    uint32_t key;             // UINT32_MAX for empty entry
+    int slot;                 // First phase slot, NO_SIGNAL if the glyph is not in atlas
+    int advance;              // Units
+} fs_GlyphEntry;
+
 typedef struct {
     fs_Glyph glyphs[GLYPHS_NUM];
-    signed long **kerning_table;
+    int16_t advance[KERN_DIM];  // Packed advance per byte in units, 0 without glyph
+    int16_t *kerning;           // Flat pair table [previous * KERN_DIM + current] in units
+    int unit;                   // Advance and kerning units per atlas pixel - 64 (26.6) with phases, else 1
+    int phases;                 // Horizontal phase variants of each glyph in atlas
+    int glyphs_num;             // Glyph slots in atlas, baked and on demand
+    int glyphs_baked;           // ASCII slots, GLYPHS_NUM * phases
+    int channels;               // Bytes per atlas pixel - 3 for LCD subpixel coverage, 1 for grayscale
+    FT_Library ft_lib;          // Kept open to rasterize glyphs on demand, main thread
+    FT_Face faces[FALLBACK_NUM + 1]; // Font and fallbacks, fallbacks are opened on first use
+    unsigned faces_tried;       // Bit per face, set once opening was attempted
+    const fs_Fonts *src;        // Fallback paths
+    fs_GlyphEntry *map;         // Face << 24 | glyph index to slot, GLYPH_MAP entries
+    int map_num;
+    fs_GlyphEntry *cover;       // Codepoint to slot across faces, COVER_MAP entries - faces are probed once per codepoint
+    int cover_num;
+    fs_GlyphLog *log;           // Moves to the GL side with the textures
+#ifdef FS_USE_HARFBUZZ
+    hb_font_t *hb_font;
+#endif
+    size_t memory;              // Bytes of textures and tables
+    size_t gpu_memory;          // Part of memory in atlas texture and metrics buffer
+    float scale;                // Content scale the atlas is rasterized at - atlas pixels per logical pixel
+    unsigned gen;               // Generation, bumped on every rebuild
     GLfloat gamma;
-    GLuint line_height;
-    GLuint tex_id;
-    GLuint tex_metrics_id;
+    GLuint line_height;         // Logical pixels
+    int line_px;                // Atlas pixels
     GLuint tex_width;
     GLuint tex_height;
 } fs_Atlas;
 
+// Atlas rasterized on the CPU, waiting for upload
+typedef struct {
+    fs_Atlas atlas;
+    unsigned char *pixels;  // tex_width * tex_height, channels bytes per pixel
+    GLfloat *metrics;       // Glyph coordinates and metrics, glyphs_num * 2 RGBA interleaved
+} fs_AtlasImage;
+
+// GL side of an atlas
+typedef struct {
+    GLuint tex_id;
+    GLuint tex_width;
+    GLuint tex_height;
+    int channels;
+    int glyphs_num;
+    int metrics_base;         // First texel of the font in the shared metrics buffer
+    float scale;
+    GLfloat gamma;
+    unsigned gen;
+    fs_GlyphLog *log;         // Glyphs on demand of this generation
+    int applied;              // Patches uploaded
+} fs_AtlasTex;
+
+// Background atlas rebuild after content scale change
+typedef struct {
+    float scale;                          // Content scale being baked
+    fs_AtlasImage *images[FONTS_NUM];
+    int next;                             // Next font to bake without threads
+    int running;
+    int restart;                          // Scale changed while baking
+#ifdef FS_THREADS
+    thrd_t thread;
+    atomic_int done;
+    int threaded;
+#endif
+} fs_Rebuild;
+
+#ifdef FS_RENDER_THREAD
+#define FS_ATOMIC _Atomic
+#else
+#define FS_ATOMIC
+#endif
+
 typedef struct {
-    char text[MAX_LEN + 1];  // Input text
-    vec4 pos;                // Inputbox position: x,y,w,h
+    char *text;              // Input text - buffer of MAX_LEN + 1 owned by fs_Boxes
     float len_pixel;         // Text pixel length
-    int len_char;            // Text char length
+    int len_char;            // Text length in bytes, whole UTF-8 characters
     int flag;                // Text or numeric
 } fs_Box;
 
+FS_VECTOR(fs_BoxVector, fs_Box, VEC_INLINE_CAP);
+
 typedef struct {
-    fs_Vector *box;
+    fs_Geometry geom;   // Inputbox positions x,y,w,h
+    fs_BoxVector box;
+    char **text;        // Text buffers by inputbox index, kept between screen rebuilds
+    int text_num;       // Number of allocated text buffers
     int selected;       // Index of selected inputbox
     int commited;       // ENTER pressed
     int count;          // Number of inputbox on current screen
 } fs_Boxes;
 
 typedef struct {
-    fs_Boxes boxes[SCREEN_NUM];
+    fs_Boxes *boxes;    // Per screen, grown with the screen registry
     vec4 bg_col;
     vec4 fg_col;
     vec4 sel_col;
 } fs_Inputbox;
 
 typedef struct {
-    char text[MAX_LEN + 1]; // Text on button
-    vec4 pos;               // Position: x,y,w,h
+    const char *text;       // Text on button - arena string
 } fs_Button;
 
+FS_VECTOR(fs_ButtonVector, fs_Button, VEC_INLINE_CAP);
+
 typedef struct {
-    fs_Vector *button;
+    fs_Geometry geom;  // Button positions x,y,w,h
+    fs_ButtonVector button;
     vec4 normal_col;
     vec4 text_col;
     vec4 hover_col;
@@ -131,60 +365,477 @@ typedef struct {
     GLuint program;
     GLuint vao;
     GLuint vbo_quad;
-    GLuint vbo_instance_data;  // Instance data
-    GLuint vbo_instance_color; // Instance color
+    GLuint vbo_instance_data;  // Packed instance position, glyph and color index
+    GLuint ubo_palette;        // Text colors
+    GLuint tbo_metrics;        // Glyph coordinates and metrics of all fonts, texture buffer on unit 1
+    GLuint tex_metrics;
+    GLint uniform[UNIFORMS_NUM];         // Per draw uniform locations, -1 if the program has none
+    uint32_t uniform_bits[UNIFORMS_NUM][4]; // Values as last set - zero as linked
+    FS_ATOMIC size_t stream_bytes; // Largest instance upload, bound of the streamed vertex buffer
 } fs_Shader;
 
+// GL side bindings as last set - binding the bound object again is skipped. Objects are bound through
+// fs_gl_* only, deleted textures are dropped with fs_gl_delete_texture.
+typedef struct {
+    GLuint program;
+    GLuint vao;
+    GLuint array_buffer;
+    int unit;                        // Active texture unit
+    GLuint texture[2];               // Unit 0 atlas and layer 2D textures, unit 1 the metrics buffer
+    unsigned long changes, skipped;  // Binds and uniform updates made and skipped by the frame being submitted
+    FS_ATOMIC unsigned long frame_changes, frame_skipped; // Of the last submitted frame
+} fs_GLState;
+
+// View block shared by all programs, std140
+typedef struct {
+    mat4 transform;   // Scroll transformation
+    vec2 res;         // Window or layer size in logical pixels
+    float scale;      // Framebuffer pixels per logical pixel
+    float pad;
+} fs_View;
+
+// Program binary cache file header, binary follows
+typedef struct {
+    uint32_t magic;
+    uint32_t format;  // Driver binary format
+    uint64_t key;     // Hash of renderer, version and sources
+    uint32_t length;
+} fs_ProgramHeader;
+
 typedef struct {
-    float factor;    // Slow down factor
-    float depth;     // Max depth of objects
-    float offset;    // Offset y
-    float max;       // Max depth of objects
-    float speed;     // Slow down speed
-    int direction;   // Direction up or down
+    float depth;      // Max depth of objects
+    float offset;     // Offset y - content moves by offset / 2 pixels
+    float max;        // Max depth of objects
+    float velocity;   // Kinetic scroll velocity, offset units per second
+    float target;     // Smooth scroll target offset
+    double time;      // Time of last scroll update
+    ScrollMode mode;  // Kinetic or smooth scrolling
 } fs_Scroll;
 
 typedef struct {
-    vec4 pos; // Position: x,y,w,h
-    vec4 col;
+    double target_fps;       // Redraw rate cap, 0 for no cap
+    double timer;            // Time of next requested wakeup or 0
+    double last_present;     // Time of last buffer swap
+    double frame_time;       // Last frame render and swap duration in seconds
+    double interval_avg;     // Average time between presented frames
+    double interval_max;     // Longest time between presented frames
+    unsigned long frames;    // Frames presented
+    unsigned long wakeups;   // Event loop iterations
+    unsigned long skipped;   // Wakeups without redraw - events coalesced or nothing changed
+    int swap_interval;       // Buffer swap interval
+    int dirty;               // Redraw requested
+    int animating;           // Continuous redraw needed (scroll inertia)
+    int hover_button;        // Button under cursor at last cursor event
+    int hover_area;          // Area under cursor at last cursor event
+} fs_Scheduler;
+
+// Input event as delivered by GLFW, applied when fs_render_ui drains the queue
+typedef struct {
+    double time;      // glfwGetTime when GLFW delivered it
+    InputKind kind;
+    int code;         // Codepoint, key or mouse button
+    int action, mods;
+    double x, y;      // Scroll offsets or cursor position in window coordinates
+} fs_Event;
+
+typedef struct {
+    fs_Event events[INPUT_QUEUE];
+    unsigned head, tail;                  // Ring buffer, drained from head
+    unsigned long received[INPUT_KINDS];  // Events delivered by GLFW
+    unsigned long coalesced[INPUT_KINDS]; // Scroll and cursor events merged into the next one of a run
+    unsigned long idle[INPUT_KINDS];      // Events that requested no redraw
+    unsigned long overflows;              // Full queue drained from inside a callback
+    // Events applied since the last present - latency is known once their frame is out
+    unsigned long pending[INPUT_KINDS];
+    double pending_sum[INPUT_KINDS];      // Sum of their timestamps
+    double pending_oldest[INPUT_KINDS];
+    // Input to present latency
+    unsigned long presented[INPUT_KINDS];
+    double latency_sum[INPUT_KINDS];
+    double latency_max[INPUT_KINDS];
+    double latency_last;                  // Oldest event of the last presented frame
+} fs_Input;
+
+// Input recording file header, fs_Record entries follow up to a RECORD_END record and the final frame hash
+typedef struct {
+    uint32_t magic;
+    int32_t width, height;    // Window size in screen coordinates
+    float scale;              // Content scale of the recording
+} fs_RecordHeader;
+
+typedef struct {
+    uint32_t delta;           // Microseconds since previous record
+    uint8_t kind;             // InputKind, RECORD_RESIZE or RECORD_END
+    uint8_t action, mods, pad;
+    int32_t code;
+    float x, y;
+} fs_Record;
+
+typedef struct {
+    FILE *fp;                 // Recording file, NULL when not recording
+    double start;             // Recording or replay start time
+    uint64_t last;            // Microseconds from start to the last record
+    unsigned long records;
+    fs_Event *events;         // Replayed events, time from replay start - NULL when not replaying
+    size_t events_num, next;
+    int width, height;        // Recorded window size
+    int done;                 // All events fed and final frame hashed
+    uint64_t expected;        // Final frame hash of the recording, 0 if unknown
+    uint64_t hash;            // Final frame hash of the replay
+    float scale;              // Content scale of the recording
+    float *frame_time;        // Render and swap duration per replayed frame, seconds
+    float *interval;          // Time since previous present per replayed frame
+    size_t frames, frames_cap;
+} fs_Replay;
+
+// Fill, border and corners of a quad
+typedef struct {
+    vec4 col;         // Fill color, top
+    vec4 col2;        // Fill color, bottom - vertical gradient
+    vec4 border_col;  // Border color
+    float radius;     // Corner radius in pixels
+    float border;     // Border width in pixels, 0 for none
+} fs_Style;
+
+typedef struct {
+    fs_Style style;
 } fs_Rect;
 
+// Quad instance - all quads of a frame are one draw call
 typedef struct {
-    fs_Vector *rect;
+    vec4 rect;        // x, y, w, h in pixels
+    fs_Style style;
+} fs_Quad;
+
+FS_VECTOR(fs_QuadVector, fs_Quad, VEC_INLINE_CAP);
+
+typedef struct {
+    int16_t x, y;    // Pen position in pixels, y down from frame origin
+    uint16_t glyph;  // Glyph index in atlas
+    uint16_t color;  // Index into frame palette
+} fs_Instance;
+
+FS_VECTOR(fs_InstanceVector, fs_Instance, VEC_INLINE_CAP);
+
+// Layer of a frame - content is recorded only while the GL side has an older version
+typedef struct {
+    vec4 bounds;                         // Content area x, y, w, h in logical pixels
+    int width, height;                   // Texture size in framebuffer pixels
+    unsigned version;
+    int redraw;                          // Quads and glyphs below are recorded
+    int direct;                          // No texture - content goes to the frame lists instead
+    fs_QuadVector quads;
+    fs_InstanceVector glyphs[FONTS_NUM];
+    int origin[FONTS_NUM];               // Content y of layer top per font, whole atlas pixels
+} fs_FrameLayer;
+
+// GL side of a layer
+typedef struct {
+    GLuint fbo;
+    GLuint tex_id;
+    int width, height;
+    FS_ATOMIC unsigned version;          // Content version in texture, read by main thread
+    FS_ATOMIC unsigned failed;           // Version the framebuffer could not be created for
+} fs_LayerTex;
+
+// Everything the GL side needs to draw one frame
+typedef struct {
+    fs_QuadVector quads;                 // Rectangles, buttons and inputboxes
+    fs_InstanceVector glyphs[FONTS_NUM]; // Glyph instances per font
+    fs_Quad hover_quad;                  // Hover area background
+    fs_FrameLayer layers[LAYERS_NUM];    // Static layers, drawn below everything else
+    fs_LayerTex *layer_tex;              // Layer textures of the screen
+    int layers_num;
+    vec4 palette[PALETTE_NUM];           // Text colors
+    int palette_num;
+    float view_top;                      // Content y of window top, logical pixels
+    int origin[FONTS_NUM];               // Content y of window top per font, whole atlas pixels
+    unsigned atlas_gen[FONTS_NUM];       // Atlas generation the layout used
+    int glyph_patches[FONTS_NUM];        // Glyphs on demand the layout used
+    vec2 res;                            // Window size in logical pixels
+    float scale;                         // Content scale
+    int hover;                           // Hover area active
+    mat4 transform;                      // Scroll transformation
+    int width, height;                   // Framebuffer size
+    int swap_interval;                   // Buffer swap interval
+    int capture;                         // Also render offscreen and hash it, see fs_frame_hash
+} fs_Frame;
+
+#ifdef FS_RENDER_THREAD
+typedef struct {
+    thrd_t thread;
+    mtx_t lock;
+    cnd_t wake;               // New frame, readback or quit
+    cnd_t done;               // Readback finished
+    atomic_int ready;         // Latest published frame, FRAME_FRESH if not rendered yet
+    atomic_ulong presented;   // Frames presented by render thread
+    int write;                // Frame being built - main thread
+    int read;                 // Frame being rendered - render thread
+    int running;
+    int quit;
+    unsigned char *readback;  // Pending fs_read_pixels buffer
+} fs_RenderThread;
+#endif
+
+#ifdef FS_LAYOUT_THREADS
+typedef struct {
+    int first, last;  // Text runs [first, last)
+} fs_LayoutTask;
+
+typedef struct {
+    _Alignas(64) atomic_int next; // Next task to take, owner and thieves alike
+    int end;                      // One past last task of the queue
+} fs_PoolQueue;
+
+typedef struct fs_Pool fs_Pool;
+
+typedef struct {
+    fs_Pool *pool;
+    int id;
+} fs_PoolWorker;
+
+// Work-stealing pool for glyph layout
+struct fs_Pool {
+    thrd_t threads[FS_LAYOUT_THREADS];
+    fs_PoolWorker workers[FS_LAYOUT_THREADS];
+    fs_PoolQueue queues[FS_LAYOUT_THREADS + 1]; // Queue 0 is the calling thread
+    mtx_t lock;
+    cnd_t wake;                  // New job or quit
+    cnd_t done;                  // All workers finished
+    unsigned long job;           // Job generation
+    int busy;                    // Workers still on current job
+    int quit;
+    fs_Context *ctx;             // Current job
+    fs_Frame *frame;
+    FontType type;
+    fs_InstanceVector *glyphs;
+    fs_LayoutTask *tasks;
+    int tasks_num, tasks_cap;
+    size_t *offsets;             // First instance of each text run
+    uint16_t *colors;            // Palette index of each text run
+    size_t offsets_cap;
+};
+#endif
+
+FS_VECTOR(fs_RectVector, fs_Rect, VEC_INLINE_CAP);
+
+typedef struct {
+    fs_Geometry geom; // Rectangle positions x,y,w,h
+    fs_RectVector rect;
 } fs_Rects;
 
 typedef struct {
-    char text[MAX_LEN + 1]; // Max length of text
+    const char *text;       // Arena string, length prefixed
     vec2 pos;               // Text position x,y
     vec4 col;               // Text font color - alpha will be computed by fragment shader
 } fs_Text;
 
+FS_VECTOR(fs_TextVector, fs_Text, VEC_INLINE_CAP);
+
 typedef struct {
-    fs_Vector *text;
+    fs_TextVector text;
 } fs_Texts;
 
+// Static rects and texts rendered once into a texture
+typedef struct {
+    fs_Rects rects;
+    fs_Texts texts[FONTS_NUM];
+    vec4 bounds;              // Content area x, y, w, h on the framebuffer pixel grid, logical pixels
+    unsigned version;         // Bumped on new content and invalidation
+} fs_Layer;
+
+typedef struct {
+    fs_Layer layer[LAYERS_NUM];
+    int num;
+    int open;                 // Layer receiving fs_add_rect and fs_add_text, NO_SIGNAL if none
+    unsigned serial;          // Last version given to a layer
+} fs_Layers;
+
+// Retained elements of a screen, live in the context while the screen is active
+typedef struct {
+    fs_Areas areas;
+    fs_Buttons buttons;
+    fs_Rects rects;
+    fs_Texts texts[FONTS_NUM];
+    fs_Layers layers;
+    fs_Arena arena;
+    fs_Scroll scroll;
+} fs_Scene;
+
+// Registered screen - allocated once, the GL side keeps its address
+typedef struct {
+    fs_Scene scene;                    // Elements while another screen is active
+    fs_LayerTex layer_tex[LAYERS_NUM]; // Layer textures, GL side - kept while the screen is inactive
+} fs_Screen;
+
+// Glyph of a cached run, free of the pen start fraction - the phase is picked when the run is placed
+typedef struct {
+    int pen;                  // Atlas units from line start
+    int y;                    // Atlas pixels below first baseline
+    uint16_t slot;            // First phase slot
+} fs_RunGlyph;
+
+// Measured and laid out text run, shared by every text with the same font and string, or line breaks of a paragraph
+typedef struct {
+    uint64_t hash;            // Hash of font, atlas generation and string
+    char *text;               // Own copy of the string
+    FontType type;
+    unsigned gen;             // Atlas generation the run was measured with
+    float max_width;          // Paragraph width and row limit, 0 for a plain run
+    int max_rows;
+    int flags;                // TEXT_WRAP, TEXT_ELLIPSIS
+    char *lines;              // Paragraph text with line breaks, NULL for a plain run
+    int rows;                 // Paragraph rows
+    float width, height;      // As fs_text_width and fs_text_height, paragraph width is the widest row
+    fs_RunGlyph *glyphs;      // Template for any pen start, shaped once or laid out on first use - NULL before
+    size_t glyphs_num;
+    int chain;                // Next run in bucket
+    int prev, next;           // LRU list, head is most recently used
+} fs_Run;
+
+typedef struct {
+    fs_Run runs[RUN_CACHE_SIZE];
+    int buckets[RUN_CACHE_BUCKETS]; // First run in bucket, NO_SIGNAL if empty
+    int head, tail;                 // Most and least recently used
+    int used;                       // Runs taken, free runs are never returned before eviction
+    int bypass;                     // More live texts than runs this frame, layout skips the cache instead of thrashing it
+    unsigned long hits, misses, evictions, bypassed;
+#ifdef FS_USE_HARFBUZZ
+    hb_buffer_t *hb_buffer;
+    unsigned long shaped;           // Runs shaped - once per unique string while it stays cached
+#endif
+} fs_RunCache;
+
+// Bytes per subsystem - GPU textures and buffers as allocated, CPU heap as requested without allocator overhead
+typedef struct {
+    size_t gpu[MEM_NUM];
+    size_t cpu[MEM_NUM];
+} fs_Memory;
+
 struct fs_context {
-    fs_Atlas fonts[FONTS_NUM];    // Font atlas
+    fs_Atlas fonts[FONTS_NUM];    // Font atlas - layout metrics, main thread
+    fs_Fonts font_src[FONTS_NUM]; // Font sources for atlas rebuilds
+    fs_AtlasTex atlas_tex[FONTS_NUM];                  // Font atlas - textures, GL side
+    fs_AtlasImage *FS_ATOMIC atlas_pending[FONTS_NUM]; // Rebuilt atlases waiting for upload
+    fs_Rebuild rebuild;           // Atlas rebuild after content scale change
+    fs_RunCache runs;             // Text runs measured and laid out in earlier frames
     fs_Texts texts[FONTS_NUM];    // Text per font types
     fs_Areas areas;               // Hover areas on current screen
     fs_Buttons buttons;           // Buttons
     fs_Inputbox inputbox;         // Inputboxes
     fs_Rects rects;               // Rectangles
+    fs_Layers layers;             // Static layers on current screen
+    fs_Screen **screens;          // Screen registry
+    int screens_num;
     fs_Scroll scroll;             // Vertical scroll
-    fs_Shader area_shader;        // Shader program for hover area
+    fs_Scheduler sched;           // Redraw scheduling and frame pacing stats
+    fs_Input input;               // Input queue and input to present latency
+    fs_Replay replay;             // Input recording and headless replay
+    fs_Frame frames[FRAMES_NUM];  // Frame command lists, triple buffered with render thread
+    int swap_applied;             // GL side - swap interval currently set
+    int max_texture;              // GL_MAX_TEXTURE_SIZE, larger layers are drawn without texture
+    int capture;                  // Next built frame is captured
+    FS_ATOMIC uint64_t capture_hash;      // GL side - hash of the last captured frame
+    FS_ATOMIC unsigned long captures;     // GL side - frames captured
+#ifdef FS_RENDER_THREAD
+    fs_RenderThread render;       // GL thread consuming frames
+#endif
+#ifdef FS_LAYOUT_THREADS
+    fs_Pool pool;                 // Parallel glyph layout
+#endif
+    fs_Arena arena;               // Strings of current screen - reset by fs_clear_screen
+    fs_Arena frame_arena;         // Strings rebuilt every frame (inputbox and hover texts)
     fs_Shader quad_shader;        // Shader program for rectangles
     fs_Shader text_shader;        // Shader program for text
+    fs_Shader layer_shader;       // Shader program for layer textures
+    GLuint ubo_view;              // View block of all programs, updated once per window or layer view
+    fs_GLState gl;                // GL side - tracked bindings and state change counts
     GLFWwindow *window;           // GLFW window
-    mat4 transform;               // Runtime variable - OpenGl transformation
     float last_click;             // Runtime variable - last click time
-    double mx, my;                // Runtime variable - mouse x,y position
+    double mx, my;                // Runtime variable - mouse x,y position, logical pixels
     int double_click;             // Runtime variable - double click flag
     int screen;                   // Runtime variable - current screen
-    int width, height;            // Runtime variable - window size
+    int width, height;            // Runtime variable - window size, logical pixels
+    int fb_width, fb_height;      // Runtime variable - framebuffer size
+    float scale;                  // Runtime variable - content scale, framebuffer pixels per logical pixel
+    float cursor_scale;           // Runtime variable - logical pixels per window coordinate
 };
 
 #ifdef FS_IMPLEMENTATION
 
+#ifdef FS_PROFILE
+typedef struct {
+    const char *name;  // Scope name - must be a static string
+    double ts;         // Timestamp in microseconds
+    char phase;        // 'B' begin or 'E' end
+    int tid;           // 0 main thread, 1 render thread, 2 atlas bake thread
+} fs_ProfileEvent;
+
+static struct {
+    fs_ProfileEvent events[FS_PROFILE_EVENTS];
+    int count;    // Buffered events
+    int written;  // Events written to file
+    FILE *fp;
+#ifdef FS_THREADS
+    atomic_flag lock;
+#endif
+} fs_profile;
+
+#ifdef FS_THREADS
+static _Thread_local int fs_profile_tid;
+#else
+static int fs_profile_tid;
+#endif
+
+static void fs_profile_flush(void)
+{
+    if (fs_profile.fp == NULL) {
+        fs_profile.fp = fopen(FS_PROFILE_FILE, "w");
+        if (fs_profile.fp == NULL) {
+            fs_profile.count = 0;
+            return;
+        }
+        fprintf(fs_profile.fp, "[\n");
+    }
+
+    for (int i = 0; i < fs_profile.count; ++i) {
+        fs_ProfileEvent *e = &fs_profile.events[i];
+        fprintf(fs_profile.fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%d}",
+                fs_profile.written++ ? ",\n" : "", e->name, e->phase, e->ts, e->tid);
+    }
+    fs_profile.count = 0;
+}
+
+static void fs_profile_event(const char *name, char phase)
+{
+#ifdef FS_THREADS
+    while (atomic_flag_test_and_set(&fs_profile.lock)) {
+    }
+#endif
+    if (fs_profile.count == FS_PROFILE_EVENTS) {
+        fs_profile_flush();
+    }
+    fs_ProfileEvent *e = &fs_profile.events[fs_profile.count++];
+    e->name  = name;
+    e->ts    = glfwGetTime() * 1e6;
+    e->phase = phase;
+    e->tid   = fs_profile_tid;
+#ifdef FS_THREADS
+    atomic_flag_clear(&fs_profile.lock);
+#endif
+}
+
+static void fs_profile_close(void)
+{
+    fs_profile_flush();
+    if (fs_profile.fp) {
+        fprintf(fs_profile.fp, "\n]\n");
+        fclose(fs_profile.fp);
+        fs_profile.fp = NULL;
+    }
+}
+#endif // FS_PROFILE
+
 inline static void fs_vec2_copy(vec2 dest, vec2 src)
 {
     dest[0] = src[0];
@@ -246,203 +897,1769 @@ static void fs_mat4_translate(mat4 m, vec3 v)
     fs_vec4_muladds(m[2], v[2], m[3]);
 }
 
-static fs_Vector *fs_vector_init(size_t data_size, size_t capacity)
-{
-    fs_Vector *vector = malloc(sizeof(fs_Vector));
-
-    if (vector == NULL) {
-        assert(0 && "Failed to initialize vector");
+#define FS_VECTOR_FUNCS(name, prefix, T)                                     \
+    inline static T *prefix##_at(name *vec, size_t index)                    \
+    {                                                                        \
+        return ((vec->heap ? vec->heap : vec->small) + index);               \
+    }                                                                        \
+                                                                             \
+    /* Returns 0 if out of memory, items are kept */                         \
+    static int prefix##_reserve(name *vec, size_t capacity)                  \
+    {                                                                        \
+        size_t inline_cap = sizeof(vec->small) / sizeof(T);                  \
+        if (capacity <= (vec->heap ? vec->capacity : inline_cap)) {          \
+            return (1);                                                      \
+        }                                                                    \
+        T *items = realloc(vec->heap, capacity * sizeof(T));                 \
+        if (items == NULL) {                                                 \
+            return (0);                                                      \
+        }                                                                    \
+        if (vec->heap == NULL) {                                             \
+            memcpy(items, vec->small, vec->size * sizeof(T));                \
+        }                                                                    \
+        vec->heap     = items;                                               \
+        vec->capacity = capacity;                                            \
+        return (1);                                                          \
+    }                                                                        \
+                                                                             \
+    /* Returns slot for the new item or NULL if out of memory */             \
+    inline static T *prefix##_push(name *vec)                                \
+    {                                                                        \
+        size_t capacity = vec->heap ? vec->capacity : sizeof(vec->small) / sizeof(T); \
+        if (vec->size == capacity && !prefix##_reserve(vec, capacity * 2)) { \
+            fprintf(stderr, "Error: out of memory, " #T " dropped\n");       \
+            return (NULL);                                                   \
+        }                                                                    \
+        return (prefix##_at(vec, vec->size++));                              \
+    }                                                                        \
+                                                                             \
+    inline static void prefix##_clear(name *vec)                             \
+    {                                                                        \
+        vec->size = 0;                                                       \
+    }                                                                        \
+                                                                             \
+    inline static void prefix##_free(name *vec)                              \
+    {                                                                        \
+        free(vec->heap);                                                     \
+        vec->heap     = NULL;                                                \
+        vec->capacity = 0;                                                   \
+        vec->size     = 0;                                                   \
     }
-    vector->capacity = capacity;
-    vector->size     = 0;
 
-    vector->items = malloc(vector->capacity * data_size);
-    if (vector->items == NULL) {
-        assert(0 && "Failed to initialize vector");
+FS_VECTOR_FUNCS(fs_AreaVector, fs_area_vector, fs_Area)
+FS_VECTOR_FUNCS(fs_BoxVector, fs_box_vector, fs_Box)
+FS_VECTOR_FUNCS(fs_ButtonVector, fs_button_vector, fs_Button)
+FS_VECTOR_FUNCS(fs_RectVector, fs_rect_vector, fs_Rect)
+FS_VECTOR_FUNCS(fs_TextVector, fs_text_vector, fs_Text)
+FS_VECTOR_FUNCS(fs_QuadVector, fs_quad_vector, fs_Quad)
+FS_VECTOR_FUNCS(fs_InstanceVector, fs_instance_vector, fs_Instance)
+
+// Heap bytes of a vector, inline items are part of its owner
+#define FS_VECTOR_BYTES(vec) ((vec)->heap ? (vec)->capacity * sizeof(*(vec)->heap) : 0)
+
+// Returns 0 if out of memory, items are kept
+static int fs_geometry_reserve(fs_Geometry *geom, size_t capacity)
+{
+    capacity = (capacity + GEOM_ALIGN - 1) & ~(size_t)(GEOM_ALIGN - 1);
+    if (capacity <= geom->capacity) {
+        return (1);
     }
-    vector->item_size = data_size;
 
-    return (vector);
+    float **arrays[] = { &geom->x, &geom->y, &geom->w, &geom->h };
+    for (int i = 0; i < 4; ++i) {
+        float *items = realloc(*arrays[i], capacity * sizeof(float));
+        if (items == NULL) {
+            return (0);
+        }
+        *arrays[i] = items;
+    }
+    geom->capacity = capacity;
+    return (1);
 }
 
-static void fs_vector_add(fs_Vector *vec, const void *data)
+static int fs_geometry_add(fs_Geometry *geom, vec4 pos)
 {
-    if (vec->size == vec->capacity) {
-        vec->capacity *= 2;
-        vec->items     = realloc(vec->items, vec->capacity * vec->item_size);
-        if (vec->items == NULL) {
-            assert(0 && "Failed to resize vector");
-        }
+    if (geom->size == geom->capacity && !fs_geometry_reserve(geom, geom->capacity ? geom->capacity * 2 : VEC_INIT_CAP)) {
+        fprintf(stderr, "Error: out of memory, element dropped\n");
+        return (0);
     }
 
-    memcpy((char *)vec->items + vec->size * vec->item_size, data, vec->item_size);
-    vec->size++;
+    geom->x[geom->size] = pos[0];
+    geom->y[geom->size] = pos[1];
+    geom->w[geom->size] = pos[2];
+    geom->h[geom->size] = pos[3];
+    geom->size++;
+    return (1);
 }
 
-inline static void *fs_vector_get(fs_Vector *vector, size_t index)
+inline static void fs_geometry_free(fs_Geometry *geom)
 {
-    return ((char *)(vector->items) + vector->item_size * index);
+    free(geom->x);
+    free(geom->y);
+    free(geom->w);
+    free(geom->h);
+    memset(geom, 0, sizeof(fs_Geometry));
 }
 
-inline static void fs_vector_reset(fs_Vector *vector)
+// Plain style of one color
+inline static fs_Style fs_style(vec4 col)
 {
-    memset((char *)(vector->items), 0, vector->size * vector->item_size);
-    vector->size = 0;
+    fs_Style style = { 0 };
+    fs_vec4_copy(style.col, col);
+    fs_vec4_copy(style.col2, col);
+    fs_vec4_copy(style.border_col, col);
+    return (style);
 }
 
-inline static void fs_vector_free(fs_Vector *vector)
+// Quad of element i, negative width or height is flipped for the fragment shader distance
+inline static void fs_quad_set(fs_Quad *quad, fs_Geometry *geom, size_t i, fs_Style *style)
 {
-    if (vector) {
-        if (vector->items) {
-            free(vector->items);
-        }
-        free(vector);
+    quad->rect[0] = geom->w[i] < 0 ? geom->x[i] + geom->w[i] : geom->x[i];
+    quad->rect[1] = geom->h[i] < 0 ? geom->y[i] + geom->h[i] : geom->y[i];
+    quad->rect[2] = fabsf(geom->w[i]);
+    quad->rect[3] = fabsf(geom->h[i]);
+    quad->style   = *style;
+}
+
+// Bit n set if point is strictly inside element i + n, for FS_SIMD_WIDTH elements
+inline static int fs_geometry_hit_mask(fs_Geometry *geom, size_t i, float px, float py)
+{
+    int mask;
+#if FS_SIMD_WIDTH == 8
+    __m256 x = _mm256_loadu_ps(geom->x + i), y = _mm256_loadu_ps(geom->y + i);
+    __m256 w = _mm256_loadu_ps(geom->w + i), h = _mm256_loadu_ps(geom->h + i);
+    __m256 p = _mm256_set1_ps(px), q = _mm256_set1_ps(py);
+    __m256 m = _mm256_and_ps(_mm256_cmp_ps(p, x, _CMP_GT_OQ), _mm256_cmp_ps(p, _mm256_add_ps(x, w), _CMP_LT_OQ));
+    m    = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(q, y, _CMP_GT_OQ), _mm256_cmp_ps(q, _mm256_add_ps(y, h), _CMP_LT_OQ)));
+    mask = _mm256_movemask_ps(m);
+#elif FS_SIMD_WIDTH == 4
+    __m128 x = _mm_loadu_ps(geom->x + i), y = _mm_loadu_ps(geom->y + i);
+    __m128 w = _mm_loadu_ps(geom->w + i), h = _mm_loadu_ps(geom->h + i);
+    __m128 p = _mm_set1_ps(px), q = _mm_set1_ps(py);
+    __m128 m = _mm_and_ps(_mm_cmpgt_ps(p, x), _mm_cmplt_ps(p, _mm_add_ps(x, w)));
+    m    = _mm_and_ps(m, _mm_and_ps(_mm_cmpgt_ps(q, y), _mm_cmplt_ps(q, _mm_add_ps(y, h))));
+    mask = _mm_movemask_ps(m);
+#else
+    mask = px > geom->x[i] && px < geom->x[i] + geom->w[i] && py > geom->y[i] && py < geom->y[i] + geom->h[i];
+#endif
+    // Drop padding lanes past the last element
+    if (geom->size - i < FS_SIMD_WIDTH) {
+        mask &= (1 << (geom->size - i)) - 1;
     }
+    return (mask);
 }
 
-static float fs_text_width(fs_Atlas *atlas, const char *text)
+// Bit n set if element i + n overlaps view x0,y0,x1,y1 - negative width or height allowed
+inline static int fs_geometry_overlap_mask(fs_Geometry *geom, size_t i, vec4 view)
 {
-    float         width    = 0;
-    unsigned char previous = 32;
+    int mask;
+#if FS_SIMD_WIDTH == 8
+    __m256 x = _mm256_loadu_ps(geom->x + i), y = _mm256_loadu_ps(geom->y + i);
+    __m256 x1 = _mm256_add_ps(x, _mm256_loadu_ps(geom->w + i)), y1 = _mm256_add_ps(y, _mm256_loadu_ps(geom->h + i));
+    __m256 m = _mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(x, x1), _mm256_set1_ps(view[2]), _CMP_LT_OQ),
+                             _mm256_cmp_ps(_mm256_max_ps(x, x1), _mm256_set1_ps(view[0]), _CMP_GT_OQ));
+    m    = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(y, y1), _mm256_set1_ps(view[3]), _CMP_LT_OQ),
+                                          _mm256_cmp_ps(_mm256_max_ps(y, y1), _mm256_set1_ps(view[1]), _CMP_GT_OQ)));
+    mask = _mm256_movemask_ps(m);
+#elif FS_SIMD_WIDTH == 4
+    __m128 x = _mm_loadu_ps(geom->x + i), y = _mm_loadu_ps(geom->y + i);
+    __m128 x1 = _mm_add_ps(x, _mm_loadu_ps(geom->w + i)), y1 = _mm_add_ps(y, _mm_loadu_ps(geom->h + i));
+    __m128 m = _mm_and_ps(_mm_cmplt_ps(_mm_min_ps(x, x1), _mm_set1_ps(view[2])), _mm_cmpgt_ps(_mm_max_ps(x, x1), _mm_set1_ps(view[0])));
+    m    = _mm_and_ps(m, _mm_and_ps(_mm_cmplt_ps(_mm_min_ps(y, y1), _mm_set1_ps(view[3])), _mm_cmpgt_ps(_mm_max_ps(y, y1), _mm_set1_ps(view[1]))));
+    mask = _mm_movemask_ps(m);
+#else
+    float x0 = geom->x[i], x1 = x0 + geom->w[i], y0 = geom->y[i], y1 = y0 + geom->h[i];
+    mask = (x0 < x1 ? x0 : x1) < view[2] && (x0 > x1 ? x0 : x1) > view[0] && (y0 < y1 ? y0 : y1) < view[3] && (y0 > y1 ? y0 : y1) > view[1];
+#endif
+    if (geom->size - i < FS_SIMD_WIDTH) {
+        mask &= (1 << (geom->size - i)) - 1;
+    }
+    return (mask);
+}
 
-    for (const unsigned char *c = (const unsigned char *)text; *c; ++c) {
-        if (*c < 32 || *c > 127) {
-            continue; // Quick and dirty solution to handle unicode characters
+// Index of first element containing point or NO_SIGNAL
+static int fs_geometry_hit_first(fs_Geometry *geom, float px, float py)
+{
+    for (size_t i = 0; i < geom->size; i += FS_SIMD_WIDTH) {
+        int mask = fs_geometry_hit_mask(geom, i, px, py);
+        for (int n = 0; mask; ++n, mask >>= 1) {
+            if (mask & 1) {
+                return ((int)(i + n));
+            }
         }
-        signed long kerning = atlas->kerning_table[previous][*c];
-        width   += atlas->glyphs[*c - 32].advance_x + kerning;
-        previous = *c;
     }
-    return (width);
+    return (NO_SIGNAL);
 }
 
-static void fs_block_width(fs_Atlas *atlas, const char *text, float *width, int *rows)
+// Index of last element containing point or NO_SIGNAL
+static int fs_geometry_hit_last(fs_Geometry *geom, float px, float py)
 {
-    float row_width = 0;
-    char  *p, row_text[MAX_LEN];
+    int hit = NO_SIGNAL;
+    for (size_t i = 0; i < geom->size; i += FS_SIMD_WIDTH) {
+        int mask = fs_geometry_hit_mask(geom, i, px, py);
+        for (int n = 0; mask; ++n, mask >>= 1) {
+            if (mask & 1) {
+                hit = (int)(i + n);
+            }
+        }
+    }
+    return (hit);
+}
 
-    while (1) {
-        p = row_text;
-        while (*text != '\0' && *text != '\n') {
-            *p++ = *text++;
+static void *fs_arena_alloc(fs_Arena *arena, size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+
+    fs_ArenaBlock *block = arena->current;
+    while (block == NULL || block->used + size > block->capacity) {
+        if (block && block->next) {
+            // Reuse blocks kept from before the last reset
+            block       = block->next;
+            block->used = 0;
+            continue;
         }
-        *p        = '\0';
-        row_width = fs_text_width(atlas, row_text);
-        if (row_width > *width) {
-            *width = row_width;
+
+        size_t         capacity = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+        fs_ArenaBlock *next     = malloc(sizeof(fs_ArenaBlock) + capacity);
+        if (next == NULL) {
+            assert(0 && "Failed to grow arena");
         }
-        *rows += 1;
-        if (*text == '\0') {
-            break;
+        next->next     = NULL;
+        next->capacity = capacity;
+        next->used     = 0;
+        if (block) {
+            block->next = next;
+        } else {
+            arena->first = next;
         }
-        text++;
+        block = next;
     }
+
+    arena->current = block;
+    void *ptr      = block->data + block->used;
+    block->used   += size;
+    return (ptr);
 }
 
-static float fs_text_height(fs_Atlas *atlas, const char *text)
+// Copy string into arena as [uint32 length][chars]['\0'], returns pointer to chars
+static const char *fs_arena_str(fs_Arena *arena, const char *text, size_t len)
 {
-    float height = 0;
+    uint32_t *prefix = fs_arena_alloc(arena, sizeof(uint32_t) + len + 1);
+    char     *str    = (char *)(prefix + 1);
 
-    for (const unsigned char *c = (const unsigned char *)text; *c; ++c) {
-        if (atlas->glyphs[*c - 32].bitmap_height > height) {
-            height = atlas->glyphs[*c - 32].bitmap_height;
-        }
-    }
-    return (height);
+    *prefix = (uint32_t)len;
+    memcpy(str, text, len);
+    str[len] = '\0';
+    return (str);
 }
 
-static char *fs_get_inputbox_content(fs_Context *ctx, int index)
+inline static size_t fs_str_len(const char *str)
 {
-    if (ctx->inputbox.boxes[ctx->screen].box->size < index) {
-        return (NULL);
+    return (((const uint32_t *)str)[-1]);
+}
+
+inline static void fs_arena_reset(fs_Arena *arena)
+{
+    arena->current = arena->first;
+    if (arena->current) {
+        arena->current->used = 0;
     }
-    fs_Box *box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, index);
-    return (box->text);
 }
 
-static void fs_set_inputbox_content(fs_Context *ctx, int index, char *text)
+static void fs_arena_free(fs_Arena *arena)
 {
-    if (ctx->inputbox.boxes[ctx->screen].box->size < index) {
-        return;
+    fs_ArenaBlock *block = arena->first;
+    while (block) {
+        fs_ArenaBlock *next = block->next;
+        free(block);
+        block = next;
     }
-    fs_Box *box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, index);
-    memset(box->text, 0, MAX_LEN + 1);
-    strncpy(box->text, text, MAX_LEN);
-    box->len_char  = strlen(text);
-    box->len_pixel = fs_text_width(&ctx->fonts[BOX], text) + PADDING;
+    arena->first   = NULL;
+    arena->current = NULL;
 }
 
-static void fs_error_callback(int error, const char *description)
+inline static int fs_kerning(fs_Atlas *atlas, unsigned char previous, unsigned char current)
 {
-    fprintf(stderr, "Error: %s (%d)\n", description, error);
+    return (atlas->kerning[previous * KERN_DIM + current]);
 }
 
-static void fs_char_callback(GLFWwindow *window, unsigned int codepoint)
+// Render glyph of face at phase into its slot, LCD subpixels or grayscale as the atlas stores them
+static FT_Error fs_load_glyph(fs_Atlas *atlas, FT_Face face, FT_UInt index, int phase)
 {
-    fs_Context *ctx = (fs_Context *)glfwGetWindowUserPointer(window);
+    FT_Int32 target = atlas->channels == 3 ? FT_LOAD_TARGET_LCD : FT_LOAD_TARGET_LIGHT;
+    if (atlas->phases <= 1) {
+        return (FT_Load_Glyph(face, index, FT_LOAD_RENDER | target));
+    }
+    FT_Error error = FT_Load_Glyph(face, index, target);
+    if (error) {
+        return (error);
+    }
+    FT_Outline_Translate(&face->glyph->outline, phase * 64 / atlas->phases, 0);
+    return (FT_Render_Glyph(face->glyph, atlas->channels == 3 ? FT_RENDER_MODE_LCD : FT_RENDER_MODE_LIGHT));
+}
 
-    if (ctx->inputbox.boxes[ctx->screen].selected == NO_SIGNAL) {
-        return;
+// Map entry of key, empty entry to fill if missing. NULL if the map is half full.
+static fs_GlyphEntry *fs_map_entry(fs_GlyphEntry *map, int size, int num, uint32_t key)
+{
+    uint32_t h = (key * 2654435761u) & (size - 1);
+    while (map[h].key != UINT32_MAX && map[h].key != key) {
+        h = (h + 1) & (size - 1);
+    }
+    if (map[h].key == UINT32_MAX && num >= size / 2) {
+        return (NULL);
     }
-    fs_Box *box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, ctx->inputbox.boxes[ctx->screen].selected);
+    return (&map[h]);
+}
 
-    // Clear inputbox if double clicked
-    if (ctx->double_click == GLFW_TRUE) {
-        memset(box->text, 0, MAX_LEN + 1);
-        box->len_char     = 0;
-        box->len_pixel    = 0;
-        ctx->double_click = GLFW_FALSE;
+// Slot of glyph index in face, glyphs outside the baked ASCII set are rasterized into the extra region on first use.
+// Main thread only. Entry slot is NO_SIGNAL if the glyph failed or the region is full, NULL if the map is full.
+static fs_GlyphEntry *fs_atlas_glyph(fs_Atlas *atlas, int face, FT_UInt index)
+{
+    uint32_t       key   = (uint32_t)face << 24 | index;
+    fs_GlyphEntry *entry = fs_map_entry(atlas->map, GLYPH_MAP, atlas->map_num, key);
+    if (entry == NULL || entry->key == key) {
+        return (entry);
+    }
+    entry->key     = key;
+    entry->slot    = NO_SIGNAL;
+    entry->advance = 0;
+    atlas->map_num++;
+
+    fs_GlyphLog *log  = atlas->log;
+    FT_GlyphSlot slot = atlas->faces[face]->glyph;
+    int          x = log->x, y = log->y, shelf = log->shelf, num = log->num; // Restored if a phase fails
+    if (log->num + atlas->phases > atlas->glyphs_num - atlas->glyphs_baked) {
+        fprintf(stderr, "Error: no atlas slot for glyph %u\n", index);
+        return (entry);
     }
 
-    // Character check in numeric inputbox
-    if (box->flag == NUM && !((codepoint >= '0' && codepoint <= '9') || codepoint == '.' || codepoint == '-')) {
-        return;
+    for (int phase = 0; phase < atlas->phases; ++phase) {
+        if (fs_load_glyph(atlas, atlas->faces[face], index, phase)) {
+            fprintf(stderr, "Error: loading glyph %u failed\n", index);
+            log->x = x, log->y = y, log->shelf = shelf, log->num = num;
+            return (entry);
+        }
+        int width  = slot->bitmap.width / atlas->channels;
+        int height = slot->bitmap.rows;
+        if (log->x + width + 1 >= (int)atlas->tex_width) {
+            log->y    += log->shelf;
+            log->x     = 0;
+            log->shelf = 0;
+        }
+        if (log->y0 + log->y + height > (int)atlas->tex_height) {
+            fprintf(stderr, "Error: atlas region for glyphs on demand is full\n");
+            log->x = x, log->y = y, log->shelf = shelf, log->num = num;
+            return (entry);
+        }
+
+        for (int row = 0; row < height; ++row) {
+            unsigned char *dst = log->pixels + ((size_t)(log->y + row) * atlas->tex_width + log->x) * atlas->channels;
+            memcpy(dst, slot->bitmap.buffer + row * slot->bitmap.pitch, width * atlas->channels);
+#ifndef FS_TEXT_REFERENCE
+            for (int i = 0; i < width * atlas->channels; ++i) {
+                dst[i] = log->gamma_lut[dst[i]];
+            }
+#endif
+        }
+
+        fs_GlyphPatch *patch = &log->patches[log->num];
+        patch->slot          = atlas->glyphs_baked + log->num++;
+        patch->x             = log->x;
+        patch->y             = log->y0 + log->y;
+        patch->width         = width;
+        patch->height        = height;
+        patch->metrics[0]    = patch->x / (float)atlas->tex_width;
+        patch->metrics[1]    = patch->y / (float)atlas->tex_height;
+        patch->metrics[2]    = width / (float)atlas->tex_width;
+        patch->metrics[3]    = height / (float)atlas->tex_height;
+        patch->metrics[4]    = slot->bitmap_left / (float)atlas->tex_width;
+        patch->metrics[5]    = slot->bitmap_top / (float)atlas->tex_height;
+        patch->metrics[6]    = width / (float)atlas->tex_width;
+        patch->metrics[7]    = -height / (float)atlas->tex_height;
+
+        log->shelf = height > log->shelf ? height : log->shelf;
+        log->x    += width + 1;
+        if (phase == 0) {
+            entry->advance = atlas->phases > 1 ? (slot->linearHoriAdvance + 512) >> 10 : slot->advance.x >> 6;
+        }
     }
+    entry->slot = atlas->glyphs_baked + log->num - atlas->phases;
+    return (entry);
+}
 
-    // Check string lenght
-    if (strlen(box->text) == MAX_LEN - 1) {
-        return;
+// Face of the fallback chain, fallbacks are opened on first use at the size of the font. NULL if missing or failed.
+static FT_Face fs_atlas_face(fs_Atlas *atlas, int face)
+{
+    if (atlas->faces_tried >> face & 1) {
+        return (atlas->faces[face]);
     }
+    atlas->faces_tried |= 1u << face;
 
-    // Check pixel width
-    char        previous = 32;
-    signed long kerning  = 0;
-    if (box->len_char > 0) {
-        previous = box->text[box->len_char - 1];
+    const char *path = atlas->src->fallback[face - 1];
+    if (path[0] == '\0') {
+        return (NULL);
     }
-    float width = ctx->fonts[BOX].glyphs[codepoint - 32].advance_x + ctx->fonts[BOX].kerning_table[previous][codepoint];
-    if (box->len_pixel + PADDING + width > box->pos[2]) {
-        return;
+    if (FT_New_Face(atlas->ft_lib, path, 0, &atlas->faces[face]) != 0) {
+        fprintf(stderr, "Error: failed to load fallback font %s\n", path);
+        atlas->faces[face] = NULL;
+        return (NULL);
     }
+    FT_UInt dpi = lroundf(FONT_DPI * atlas->scale);
+    FT_Set_Char_Size(atlas->faces[face], 0, atlas->src->size * 64, dpi, dpi);
+    return (atlas->faces[face]);
+}
 
-    // Check if text is valid floating point number in numeric inputbox
-    box->text[box->len_char] = codepoint;
-    if (strcmp(box->text, "-") != 0 && box->flag == NUM) { // Negative sign is valid
-        char   *pEnd;
-        double value = strtod(box->text, &pEnd);
-        if (pEnd == box->text || *pEnd != '\0') {
-            box->text[box->len_char] = '\0';
-            return;
+// Decode one UTF-8 character and step past it, invalid bytes decode to U+FFFD one at a time
+static uint32_t fs_utf8_next(const unsigned char **s)
+{
+    const unsigned char *c   = *s;
+    int                  len = c[0] >= 0xF0 ? 4 : c[0] >= 0xE0 ? 3 : c[0] >= 0xC0 ? 2 : 1;
+    uint32_t             cp  = len == 1 ? c[0] : c[0] & (0x3F >> (len - 1));
+    if (len == 1 && c[0] >= 0x80) {
+        *s += 1;
+        return (0xFFFD);
+    }
+    for (int i = 1; i < len; ++i) {
+        if ((c[i] & 0xC0) != 0x80) {
+            *s += 1;
+            return (0xFFFD);
         }
+        cp = cp << 6 | (c[i] & 0x3F);
     }
+    *s += len;
+    return (cp);
+}
 
-    // All good, add character
-    box->len_char++;
-    box->len_pixel += width;
+// Encode codepoint as UTF-8 into out, returns bytes written - 0 for surrogates and values past U+10FFFF
+static int fs_utf8_encode(uint32_t cp, char *out)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return (1);
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | cp >> 6);
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return (2);
+    }
+    if (cp < 0x10000) {
+        if (cp >= 0xD800 && cp < 0xE000) {
+            return (0);
+        }
+        out[0] = (char)(0xE0 | cp >> 12);
+        out[1] = (char)(0x80 | (cp >> 6 & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return (3);
+    }
+    if (cp < 0x110000) {
+        out[0] = (char)(0xF0 | cp >> 18);
+        out[1] = (char)(0x80 | (cp >> 12 & 0x3F));
+        out[2] = (char)(0x80 | (cp >> 6 & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        return (4);
+    }
+    return (0);
 }
 
-static void fs_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+// Length of text of len bytes cut to at most max bytes, a UTF-8 character is kept whole or dropped
+static size_t fs_utf8_cut(const char *text, size_t len, size_t max)
 {
-    if (GLFW_PRESS != action && GLFW_REPEAT != action) {
-        return;
+    if (len <= max) {
+        return (len);
+    }
+    while (max > 0 && ((const unsigned char *)text)[max] >> 6 == 2) {
+        max--;
     }
+    return (max);
+}
 
-    fs_Context *ctx = (fs_Context *)glfwGetWindowUserPointer(window);
-    fs_Box     *box = NULL;
-    if (ctx->inputbox.boxes[ctx->screen].selected == NO_SIGNAL) {
-        box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, 0);
-    } else {
-        box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, ctx->inputbox.boxes[ctx->screen].selected);
+// Slot of codepoint from the first face of the chain that has it. Faces are probed once per codepoint,
+// later lookups only read the map. NULL if the map is full.
+static fs_GlyphEntry *fs_atlas_cover(fs_Atlas *atlas, uint32_t codepoint)
+{
+    fs_GlyphEntry *cover = fs_map_entry(atlas->cover, COVER_MAP, atlas->cover_num, codepoint);
+    if (cover == NULL || cover->key == codepoint) {
+        return (cover);
+    }
+    cover->key     = codepoint;
+    cover->slot    = NO_SIGNAL;
+    cover->advance = 0;
+    atlas->cover_num++;
+
+    for (int face = 0; face <= FALLBACK_NUM; ++face) {
+        FT_Face ft_face = fs_atlas_face(atlas, face);
+        FT_UInt index   = ft_face ? FT_Get_Char_Index(ft_face, codepoint) : 0;
+        if (index != 0) {
+            fs_GlyphEntry *entry = fs_atlas_glyph(atlas, face, index);
+            if (entry != NULL) {
+                cover->slot    = entry->slot;
+                cover->advance = entry->advance;
+            }
+            break;
+        }
+    }
+    return (cover);
+}
+
+// Slot of the character at c and step past it, NO_SIGNAL without glyph. previous is the ASCII glyph before for kerning,
+// it resets to space after other glyphs. Characters beyond ASCII are resolved through the fallback chain, main thread only
+// unless all of them were resolved before.
+static int fs_next_glyph(fs_Atlas *atlas, const unsigned char **c, unsigned char *previous, int *kerning, int *advance)
+{
+    unsigned char ch = **c;
+    if (ch < 0x80) {
+        *c += 1;
+        if (ch < 32 || ch - 32 >= GLYPHS_NUM) {
+            return (NO_SIGNAL);
+        }
+        *kerning  = fs_kerning(atlas, *previous, ch);
+        *advance  = atlas->advance[ch];
+        *previous = ch;
+        return ((ch - 32) * atlas->phases);
+    }
+
+    fs_GlyphEntry *cover = fs_atlas_cover(atlas, fs_utf8_next(c));
+    if (cover == NULL || cover->slot == NO_SIGNAL) {
+        return (NO_SIGNAL);
+    }
+    *kerning  = 0;
+    *advance  = cover->advance;
+    *previous = 32;
+    return (cover->slot);
+}
+
+// Reference measurement, characters without glyph are skipped
+static float fs_text_width_scalar(fs_Atlas *atlas, const char *text)
+{
+    int           width    = 0;
+    unsigned char previous = 32;
+
+    for (const unsigned char *c = (const unsigned char *)text; *c;) {
+        int kerning, advance;
+        if (fs_next_glyph(atlas, &c, &previous, &kerning, &advance) != NO_SIGNAL) {
+            width += advance + kerning;
+        }
+    }
+    return ((float)width / (atlas->unit * atlas->scale));
+}
+
+#if FS_TEXT_SIMD
+// Sum of advance and kerning of 16 printable bytes, previous is the glyph before them
+inline static int fs_text_width_16(fs_Atlas *atlas, __m128i v, int previous)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i p    = _mm_or_si128(_mm_slli_si128(v, 1), _mm_cvtsi32_si128(previous));
+#if FS_TEXT_SIMD == 32
+    __m256i sum = _mm256_setzero_si256();
+    for (int half = 0; half < 2; ++half, v = _mm_srli_si128(v, 8), p = _mm_srli_si128(p, 8)) {
+        __m256i cur  = _mm256_cvtepu8_epi32(v);
+        __m256i pair = _mm256_or_si256(_mm256_slli_epi32(_mm256_cvtepu8_epi32(p), 7), cur);
+        __m256i adv  = _mm256_i32gather_epi32((const int *)atlas->advance, cur, 2);
+        __m256i kern = _mm256_i32gather_epi32((const int *)atlas->kerning, pair, 2);
+        // Gathers load 32 bits, keep sign extended low int16
+        sum = _mm256_add_epi32(sum, _mm256_srai_epi32(_mm256_slli_epi32(adv, 16), 16));
+        sum = _mm256_add_epi32(sum, _mm256_srai_epi32(_mm256_slli_epi32(kern, 16), 16));
+    }
+    __m128i s4 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+#else
+    // No gather in SSE2 - pair indices in vector, table loads unrolled
+    uint16_t pair[16];
+    uint8_t  cur[16];
+    _mm_storeu_si128((__m128i *)cur, v);
+    _mm_storeu_si128((__m128i *)pair, _mm_or_si128(_mm_slli_epi16(_mm_unpacklo_epi8(p, zero), 7), _mm_unpacklo_epi8(v, zero)));
+    _mm_storeu_si128((__m128i *)(pair + 8), _mm_or_si128(_mm_slli_epi16(_mm_unpackhi_epi8(p, zero), 7), _mm_unpackhi_epi8(v, zero)));
+    int acc[4] = { 0 };
+    for (int i = 0; i < 16; i += 4) {
+        acc[0] += atlas->advance[cur[i + 0]] + atlas->kerning[pair[i + 0]];
+        acc[1] += atlas->advance[cur[i + 1]] + atlas->kerning[pair[i + 1]];
+        acc[2] += atlas->advance[cur[i + 2]] + atlas->kerning[pair[i + 2]];
+        acc[3] += atlas->advance[cur[i + 3]] + atlas->kerning[pair[i + 3]];
+    }
+    __m128i s4 = _mm_loadu_si128((const __m128i *)acc);
+#endif
+    s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(1, 0, 3, 2)));
+    s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(2, 3, 0, 1)));
+    (void)zero;
+    return (_mm_cvtsi128_si32(s4));
+}
+
+// Bit n set if byte n has a glyph in atlas (32..126)
+inline static int fs_printable_mask_16(__m128i v)
+{
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(31)), _mm_cmplt_epi8(v, _mm_set1_epi8(127)));
+    return (_mm_movemask_epi8(ok));
+}
+#endif
+
+// Text width in logical pixels - FS_TEXT_SIMD bytes per step while all of them have glyphs
+static float fs_text_width(fs_Atlas *atlas, const char *text)
+{
+    const unsigned char *c        = (const unsigned char *)text;
+    size_t               i        = 0;
+    int                  width    = 0;
+    unsigned char        previous = 32;
+
+#if FS_TEXT_SIMD
+    size_t len = strlen(text);
+    while (i + FS_TEXT_SIMD <= len) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(c + i));
+#if FS_TEXT_SIMD == 32
+        __m128i v1       = _mm_loadu_si128((const __m128i *)(c + i + 16));
+        int     all_text = (fs_printable_mask_16(v0) & fs_printable_mask_16(v1)) == 0xFFFF;
+#else
+        int all_text = fs_printable_mask_16(v0) == 0xFFFF;
+#endif
+        if (all_text) {
+            width += fs_text_width_16(atlas, v0, previous);
+#if FS_TEXT_SIMD == 32
+            width += fs_text_width_16(atlas, v1, c[i + 15]);
+#endif
+            previous = c[i + FS_TEXT_SIMD - 1];
+            i       += FS_TEXT_SIMD;
+            continue;
+        }
+        // Block with control or non-ASCII bytes, its last character may end past it
+        const unsigned char *p = c + i;
+        while (p < c + i + FS_TEXT_SIMD) {
+            int kerning, advance;
+            if (fs_next_glyph(atlas, &p, &previous, &kerning, &advance) != NO_SIGNAL) {
+                width += advance + kerning;
+            }
+        }
+        i = p - c;
+    }
+#endif
+
+    for (const unsigned char *p = c + i; *p;) {
+        int kerning, advance;
+        if (fs_next_glyph(atlas, &p, &previous, &kerning, &advance) != NO_SIGNAL) {
+            width += advance + kerning;
+        }
+    }
+#ifdef FS_VERIFY_SIMD
+    assert((float)width / (atlas->unit * atlas->scale) == fs_text_width_scalar(atlas, text));
+#endif
+    return ((float)width / (atlas->unit * atlas->scale));
+}
+
+static void fs_block_width(fs_Atlas *atlas, const char *text, float *width, int *rows)
+{
+    int           row_width = 0, widest = 0;
+    unsigned char previous  = 32;
+
+    for (const unsigned char *c = (const unsigned char *)text;;) {
+        int kerning, advance;
+        if (*c == '\0' || *c == '\n') {
+            widest    = row_width > widest ? row_width : widest;
+            row_width = 0;
+            previous  = 32;
+            *rows    += 1;
+            if (*c++ == '\0') {
+                break;
+            }
+        } else if (fs_next_glyph(atlas, &c, &previous, &kerning, &advance) != NO_SIGNAL) {
+            row_width += advance + kerning;
+        }
+    }
+    if (widest / (atlas->unit * atlas->scale) > *width) {
+        *width = widest / (atlas->unit * atlas->scale);
+    }
+}
+
+static float fs_text_height(fs_Atlas *atlas, const char *text)
+{
+    float height = 0;
+
+    for (const unsigned char *c = (const unsigned char *)text; *c; ++c) {
+        if (*c >= 32 && *c - 32 < GLYPHS_NUM && atlas->glyphs[*c - 32].bitmap_height > height) {
+            height = atlas->glyphs[*c - 32].bitmap_height;
+        }
+    }
+    return (height / atlas->scale);
+}
+
+// FNV-1a over string including terminator
+static uint64_t fs_hash_str(uint64_t hash, const char *s)
+{
+    do {
+        hash = (hash ^ (unsigned char)*s) * 0x100000001B3ull;
+    } while (*s++);
+    return (hash);
+}
+
+static void fs_run_unlink(fs_RunCache *cache, int i)
+{
+    fs_Run *run = &cache->runs[i];
+    if (run->prev != NO_SIGNAL) {
+        cache->runs[run->prev].next = run->next;
+    } else {
+        cache->head = run->next;
+    }
+    if (run->next != NO_SIGNAL) {
+        cache->runs[run->next].prev = run->prev;
+    } else {
+        cache->tail = run->prev;
+    }
+}
+
+static void fs_run_push_front(fs_RunCache *cache, int i)
+{
+    fs_Run *run = &cache->runs[i];
+    run->prev   = NO_SIGNAL;
+    run->next   = cache->head;
+    if (cache->head != NO_SIGNAL) {
+        cache->runs[cache->head].prev = i;
+    } else {
+        cache->tail = i;
+    }
+    cache->head = i;
+}
+
+// Drop run from its bucket and the LRU list
+static void fs_run_evict(fs_RunCache *cache, int i)
+{
+    fs_Run *run  = &cache->runs[i];
+    int    *link = &cache->buckets[run->hash & (RUN_CACHE_BUCKETS - 1)];
+    while (*link != i) {
+        link = &cache->runs[*link].chain;
+    }
+    *link = run->chain;
+    fs_run_unlink(cache, i);
+    free(run->text);
+    free(run->lines);
+    free(run->glyphs);
+    run->text   = NULL;
+    run->lines  = NULL;
+    run->glyphs = NULL;
+}
+
+static void fs_run_cache_init(fs_RunCache *cache)
+{
+    for (int i = 0; i < RUN_CACHE_BUCKETS; ++i) {
+        cache->buckets[i] = NO_SIGNAL;
+    }
+    cache->head = NO_SIGNAL;
+    cache->tail = NO_SIGNAL;
+}
+
+static void fs_run_cache_free(fs_RunCache *cache)
+{
+    for (int i = 0; i < cache->used; ++i) {
+        free(cache->runs[i].text);
+        free(cache->runs[i].lines);
+        free(cache->runs[i].glyphs);
+    }
+#ifdef FS_USE_HARFBUZZ
+    hb_buffer_destroy(cache->hb_buffer);
+    cache->hb_buffer = NULL;
+#endif
+    cache->used = 0;
+    fs_run_cache_init(cache);
+}
+
+// Width of "..." after character previous, atlas units
+static int fs_ellipsis_width(fs_Atlas *atlas, unsigned char previous)
+{
+    previous = previous >= 32 && previous - 32 < GLYPHS_NUM ? previous : 32;
+    return (3 * atlas->advance['.'] + fs_kerning(atlas, previous, '.') + 2 * fs_kerning(atlas, '.', '.'));
+}
+
+// Breaks text into rows at most max_width logical pixels wide (0 for any width), and at most max_rows rows (0 for any).
+// TEXT_WRAP breaks rows after words and splits words wider than a row, otherwise rows are cut at the width.
+// TEXT_ELLIPSIS ends cut text with "...". Returns malloc'd text with '\n' between rows, NULL if out of memory.
+static char *fs_break_lines(fs_Atlas *atlas, const char *text, float max_width, int max_rows, int flags, int *rows, float *width)
+{
+    const unsigned char *c      = (const unsigned char *)text;
+    size_t               len    = strlen(text);
+    int                  limit  = max_width > 0 ? (int)floorf(max_width * atlas->unit * atlas->scale) : INT_MAX;
+    int                  widest = 0;
+    int                  pen[MAX_LEN + 4]; // Row width before each byte, atlas units
+
+    len       = fs_utf8_cut(text, len, MAX_LEN);
+    char *out = malloc(4 * (len + 1)); // Each row adds a break and at most one ellipsis
+    if (out == NULL) {
+        return (NULL);
+    }
+
+    size_t n = 0, i = 0;
+    *rows    = 0;
+    while (1) {
+        // Longest part of the row that fits - at least one character, so every row advances
+        size_t        start = i, space = 0;
+        unsigned char previous = 32;
+        pen[0]                 = 0;
+        while (i < len && c[i] != '\n') {
+            const unsigned char *p = c + i;
+            int                  w = pen[i - start], kerning, advance;
+            if (fs_next_glyph(atlas, &p, &previous, &kerning, &advance) != NO_SIGNAL) {
+                w += advance + kerning;
+            }
+            if (w > limit && i > start) {
+                break;
+            }
+            space = c[i] == ' ' && i > start ? i : space;
+            for (size_t j = i + 1; j < (size_t)(p - c); ++j) {
+                pen[j - start] = pen[i - start]; // Inside a multibyte character
+            }
+            i              = (size_t)(p - c) < len ? (size_t)(p - c) : len;
+            pen[i - start] = w;
+        }
+
+        size_t end = i, next = i; // Row is text[start, end), next row starts at next
+        int    cut = 0;
+        if (i < len && c[i] != '\n') {
+            if (flags & TEXT_WRAP) {
+                if (space) {
+                    end  = space;
+                    next = space + 1;
+                }
+                while (next < len && c[next] == ' ') {
+                    next++;
+                }
+            } else {
+                cut = 1;
+                while (next < len && c[next] != '\n') {
+                    next++;
+                }
+            }
+        }
+        if (next < len && c[next] == '\n') {
+            next++;
+        }
+
+        *rows += 1;
+        int more  = next < len;
+        int last  = max_rows > 0 && *rows == max_rows && more;
+        int row_w = pen[end - start];
+        if ((cut || last) && (flags & TEXT_ELLIPSIS)) {
+            while (end > start && (c[end - 1] == ' ' || pen[end - start] + fs_ellipsis_width(atlas, c[end - 1]) > limit)) {
+                end--;
+                while (end > start && (c[end] & 0xC0) == 0x80) {
+                    end--; // Whole characters only
+                }
+            }
+            row_w = pen[end - start] + fs_ellipsis_width(atlas, end > start ? c[end - 1] : 32);
+            memcpy(out + n, text + start, end - start);
+            memcpy(out + n + end - start, "...", 3);
+            n += end - start + 3;
+        } else {
+            memcpy(out + n, text + start, end - start);
+            n += end - start;
+        }
+        widest = row_w > widest ? row_w : widest;
+        if (!more || last) {
+            break;
+        }
+        out[n++] = '\n';
+        i        = next;
+    }
+    out[n] = '\0';
+    *width = (float)widest / (atlas->unit * atlas->scale);
+    return (out);
+}
+
+#ifdef FS_USE_HARFBUZZ
+// Shape text line by line into glyph slots and pen positions, glyphs without slot are dropped.
+// Width is the widest line in logical pixels. Returns malloc'd glyphs, NULL if out of memory.
+static fs_RunGlyph *fs_shape_run(fs_RunCache *cache, fs_Atlas *atlas, const char *text, size_t *num, float *width)
+{
+    FS_PROFILE_BEGIN("fs_shape_run");
+    size_t       len    = strlen(text);
+    fs_RunGlyph *shaped = malloc((len + 1) * sizeof(fs_RunGlyph));
+    if (shaped == NULL || (cache->hb_buffer == NULL && (cache->hb_buffer = hb_buffer_create()) == NULL)) {
+        free(shaped);
+        FS_PROFILE_END("fs_shape_run");
+        return (NULL);
+    }
+    cache->shaped++;
+
+    size_t n      = 0;
+    int    widest = 0, y = 0;
+    for (const char *line = text;; line += strcspn(line, "\n") + 1, y += atlas->line_px) {
+        int line_len = (int)strcspn(line, "\n");
+        hb_buffer_clear_contents(cache->hb_buffer);
+        hb_buffer_add_utf8(cache->hb_buffer, line, line_len, 0, line_len);
+        hb_buffer_guess_segment_properties(cache->hb_buffer);
+        hb_shape(atlas->hb_font, cache->hb_buffer, NULL, 0);
+
+        unsigned int         count;
+        hb_glyph_info_t     *info = hb_buffer_get_glyph_infos(cache->hb_buffer, &count);
+        hb_glyph_position_t *pos  = hb_buffer_get_glyph_positions(cache->hb_buffer, &count);
+        int                  pen  = 0; // 26.6
+        for (unsigned int i = 0; i < count && n < len; ++i) {
+            fs_GlyphEntry *entry = fs_atlas_glyph(atlas, 0, info[i].codepoint);
+            if (entry != NULL && entry->slot != NO_SIGNAL) {
+                int x           = pen + pos[i].x_offset;
+                shaped[n].pen   = atlas->unit == 64 ? x : (x + 32) >> 6;
+                shaped[n].y     = y - ((pos[i].y_offset + 32) >> 6);
+                shaped[n].slot  = entry->slot;
+                n++;
+            }
+            pen += pos[i].x_advance;
+        }
+        widest = pen > widest ? pen : widest;
+        if (line[line_len] == '\0') {
+            break;
+        }
+    }
+    *num   = n;
+    *width = widest / 64.0f / atlas->scale;
+    FS_PROFILE_END("fs_shape_run");
+    return (shaped);
+}
+#endif
+
+// Run of text in font type, measured on first use and moved to the LRU head on every use. With max_width or max_rows
+// the run holds line breaks of a paragraph, see fs_break_lines.
+// Atlas rebuilds bump the generation, so stale runs are never hit and age out. NULL if out of memory.
+static fs_Run *fs_run_find(fs_Context *ctx, FontType type, const char *text, float max_width, int max_rows, int flags)
+{
+    fs_RunCache *cache = &ctx->runs;
+    fs_Atlas    *atlas = &ctx->fonts[type];
+    uint32_t     bits;
+    memcpy(&bits, &max_width, sizeof(bits));
+    uint64_t hash   = fs_hash_str(0xCBF29CE484222325ull ^ ((uint64_t)type << 32 | atlas->gen), text);
+    hash            = (hash ^ ((uint64_t)bits << 24 ^ (uint64_t)max_rows << 8 ^ flags)) * 0x100000001B3ull;
+    int     *bucket = &cache->buckets[hash & (RUN_CACHE_BUCKETS - 1)];
+
+    for (int i = *bucket; i != NO_SIGNAL; i = cache->runs[i].chain) {
+        fs_Run *run = &cache->runs[i];
+        if (run->hash == hash && run->type == type && run->gen == atlas->gen && run->max_width == max_width && run->max_rows == max_rows &&
+            run->flags == flags && strcmp(run->text, text) == 0) {
+            if (cache->head != i) {
+                fs_run_unlink(cache, i);
+                fs_run_push_front(cache, i);
+            }
+            cache->hits++;
+            return (run);
+        }
+    }
+    cache->misses++;
+
+    size_t len   = strlen(text);
+    char  *copy  = malloc(len + 1);
+    char  *lines = NULL;
+    int    rows  = 0;
+    float  width = 0;
+    if (copy != NULL && (max_width > 0 || max_rows > 0)) {
+        lines = fs_break_lines(atlas, text, max_width, max_rows, flags, &rows, &width);
+    }
+    if (copy == NULL || ((max_width > 0 || max_rows > 0) && lines == NULL)) {
+        free(copy);
+        return (NULL);
+    }
+    memcpy(copy, text, len + 1);
+#ifdef FS_USE_HARFBUZZ
+    // Plain runs are shaped, their width is the shaped advance
+    fs_RunGlyph *shaped     = NULL;
+    size_t       shaped_num = 0;
+    if (lines == NULL && (shaped = fs_shape_run(cache, atlas, text, &shaped_num, &width)) == NULL) {
+        free(copy);
+        return (NULL);
+    }
+#endif
+
+    int i;
+    if (cache->used < RUN_CACHE_SIZE) {
+        i = cache->used++;
+    } else {
+        i = cache->tail;
+        fs_run_evict(cache, i);
+        cache->evictions++;
+    }
+    fs_Run *run    = &cache->runs[i];
+    *run           = (fs_Run){ 0 };
+    run->hash      = hash;
+    run->text      = copy;
+    run->type      = type;
+    run->gen       = atlas->gen;
+    run->max_width = max_width;
+    run->max_rows  = max_rows;
+    run->flags     = flags;
+    run->lines     = lines;
+    run->rows      = rows;
+#ifdef FS_USE_HARFBUZZ
+    run->glyphs     = shaped;
+    run->glyphs_num = shaped_num;
+    run->width      = width;
+#else
+    run->width     = lines ? width : fs_text_width(atlas, text);
+#endif
+    run->height    = fs_text_height(atlas, lines ? lines : text);
+    run->chain     = *bucket;
+    *bucket        = i;
+    fs_run_push_front(cache, i);
+    return (run);
+}
+
+inline static fs_Run *fs_run_lookup(fs_Context *ctx, FontType type, const char *text)
+{
+    return (fs_run_find(ctx, type, text, 0, 0, 0));
+}
+
+inline static float fs_run_width(fs_Context *ctx, FontType type, const char *text)
+{
+    fs_Run *run = fs_run_lookup(ctx, type, text);
+    return (run ? run->width : fs_text_width(&ctx->fonts[type], text));
+}
+
+inline static float fs_run_height(fs_Context *ctx, FontType type, const char *text)
+{
+    fs_Run *run = fs_run_lookup(ctx, type, text);
+    return (run ? run->height : fs_text_height(&ctx->fonts[type], text));
+}
+
+// Run cache effectiveness - steady state frames should only hit
+static void fs_run_cache_report(fs_Context *ctx)
+{
+    fs_RunCache  *cache   = &ctx->runs;
+    unsigned long lookups = cache->hits + cache->misses;
+    printf("Run cache: %d runs, %lu hits, %lu misses, %lu evictions, hit rate %.1f%%, %lu texts laid out uncached\n", cache->used,
+           cache->hits, cache->misses, cache->evictions, lookups ? 100.0 * cache->hits / lookups : 0.0, cache->bypassed);
+#ifdef FS_USE_HARFBUZZ
+    printf("Runs shaped: %lu\n", cache->shaped);
+#endif
+}
+
+// Request redraw on the next fs_render_ui
+inline static void fs_invalidate(fs_Context *ctx)
+{
+    ctx->sched.dirty = 1;
+}
+
+static void fs_invalidate_layer_list(fs_Layers *layers)
+{
+    for (int i = 0; i < layers->num; ++i) {
+        layers->layer[i].version = ++layers->serial;
+    }
+}
+
+// Render all layers of all screens again - content scale or font atlas changed
+static void fs_invalidate_layers(fs_Context *ctx)
+{
+    fs_invalidate_layer_list(&ctx->layers);
+    for (int i = 0; i < ctx->screens_num; ++i) {
+        fs_invalidate_layer_list(&ctx->screens[i]->scene.layers);
+    }
+    fs_invalidate(ctx);
+}
+
+static fs_AtlasImage *fs_exchange_upload(fs_AtlasImage *FS_ATOMIC *slot, fs_AtlasImage *image)
+{
+#ifdef FS_RENDER_THREAD
+    return (atomic_exchange(slot, image));
+#else
+    fs_AtlasImage *old = *slot;
+    *slot              = image;
+    return (old);
+#endif
+}
+
+// Cursor position in logical pixels
+static void fs_get_cursor(fs_Context *ctx)
+{
+    if (ctx->replay.events) {
+        return; // Replayed cursor events own the position
+    }
+    glfwGetCursorPos(ctx->window, &ctx->mx, &ctx->my);
+    ctx->mx *= ctx->cursor_scale;
+    ctx->my *= ctx->cursor_scale;
+}
+
+// Wake up fs_render_ui after given seconds even without input
+static void fs_set_timer(fs_Context *ctx, double seconds)
+{
+    double t = glfwGetTime() + seconds;
+    if (ctx->sched.timer == 0 || t < ctx->sched.timer) {
+        ctx->sched.timer = t;
+    }
+}
+
+static void fs_set_frame_rate(fs_Context *ctx, double fps)
+{
+    ctx->sched.target_fps = fps;
+}
+
+// Applied by the GL side with the next frame
+static void fs_set_swap_interval(fs_Context *ctx, int interval)
+{
+    ctx->sched.swap_interval = interval;
+}
+
+static char *fs_get_inputbox_content(fs_Context *ctx, int index)
+{
+    if (ctx->inputbox.boxes[ctx->screen].box.size < index) {
+        return (NULL);
+    }
+    fs_Box *box = fs_box_vector_at(&ctx->inputbox.boxes[ctx->screen].box, index);
+    return (box->text);
+}
+
+static void fs_set_inputbox_content(fs_Context *ctx, int index, char *text)
+{
+    if (ctx->inputbox.boxes[ctx->screen].box.size < index) {
+        return;
+    }
+    fs_Box *box = fs_box_vector_at(&ctx->inputbox.boxes[ctx->screen].box, index);
+    size_t  len = fs_utf8_cut(text, strlen(text), MAX_LEN);
+    memset(box->text, 0, MAX_LEN + 1);
+    memcpy(box->text, text, len);
+    box->len_char  = len;
+    box->len_pixel = fs_text_width(&ctx->fonts[BOX], box->text) + PADDING;
+    fs_invalidate(ctx);
+}
+
+// Main thread side of an atlas - kerning table, glyph map and face
+static void fs_free_atlas(fs_Atlas *atlas)
+{
+    free(atlas->kerning);
+    free(atlas->map);
+    free(atlas->cover);
+#ifdef FS_USE_HARFBUZZ
+    hb_font_destroy(atlas->hb_font);
+#endif
+    for (int i = 0; i <= FALLBACK_NUM; ++i) {
+        if (atlas->faces[i]) {
+            FT_Done_Face(atlas->faces[i]);
+        }
+    }
+    if (atlas->ft_lib) {
+        FT_Done_FreeType(atlas->ft_lib);
+    }
+}
+
+// Glyph slots of a font atlas, baked ASCII and on demand per phase - the same at every content scale
+inline static int fs_glyph_slots(const fs_Fonts *src)
+{
+    return ((GLYPHS_NUM + GLYPHS_EXTRA) * (src->phases > 1 ? src->phases : 1));
+}
+
+// Rasterize font at content scale into CPU memory - no GL calls, safe on any thread
+static fs_AtlasImage *fs_bake_atlas(fs_Fonts *src, float scale)
+{
+    FT_Library ft_lib = NULL;
+    FT_Face    face   = NULL;
+
+    FS_PROFILE_BEGIN("fs_bake_atlas");
+    if (FT_Init_FreeType(&ft_lib) != 0) {
+        printf("Error: failed to initialize FreeType library\n");
+        FS_PROFILE_END("fs_bake_atlas");
+        return (NULL);
+    }
+
+    if (FT_New_Face(ft_lib, src->path, 0, &face) != 0) {
+        printf("Error: failed to load font\n");
+        FT_Done_FreeType(ft_lib);
+        FS_PROFILE_END("fs_bake_atlas");
+        return (NULL);
+    }
+
+    fs_AtlasImage *image = calloc(1, sizeof(fs_AtlasImage));
+    assert(image);
+    fs_Atlas *atlas = &image->atlas;
+
+    FT_UInt dpi = lroundf(FONT_DPI * scale);
+    FT_Set_Char_Size(face, 0, src->size * 64, dpi, dpi);
+    FT_GlyphSlot slot  = face->glyph;
+    atlas->scale       = dpi / (float)FONT_DPI;
+    atlas->line_px     = face->size->metrics.height >> 6;
+    atlas->line_height = lroundf(atlas->line_px / atlas->scale);
+    atlas->gamma       = src->gamma;
+    atlas->phases      = src->phases > 1 ? src->phases : 1;
+    atlas->unit        = src->phases > 1 ? 64 : 1;
+    atlas->glyphs_baked = GLYPHS_NUM * atlas->phases;
+    atlas->glyphs_num   = fs_glyph_slots(src);
+    atlas->channels     = src->grayscale ? 1 : 3;
+    unsigned int roww = 0, rowh = 0;
+
+    fs_Glyph *slots = calloc(atlas->glyphs_num, sizeof(fs_Glyph));
+    assert(slots);
+
+    // First pass: calculate atlas dimensions
+    for (int i = 0; i < atlas->glyphs_baked; ++i) {
+        if (fs_load_glyph(atlas, face, FT_Get_Char_Index(face, i / atlas->phases + 32), i % atlas->phases)) {
+            fprintf(stderr, "Error: loading character %c failed\n", i / atlas->phases + 32);
+            continue;
+        }
+
+        unsigned int glyph_width = slot->bitmap.width / atlas->channels; // As packed below
+        if (roww + glyph_width + 1 >= MAX_WIDTH) {
+            atlas->tex_width   = atlas->tex_width > roww ? atlas->tex_width : roww;
+            atlas->tex_height += rowh;
+            roww               = 0;
+            rowh               = 0;
+        }
+        roww += glyph_width + 1;
+        rowh  = slot->bitmap.rows > rowh ? slot->bitmap.rows : rowh;
+    }
+
+    atlas->tex_width   = atlas->tex_width > roww ? atlas->tex_width : roww;
+    atlas->tex_height += rowh;
+
+    // Extra region for glyphs on demand - room for half a line square per slot
+    int extra_rows = (int)(((size_t)GLYPHS_EXTRA * atlas->phases * atlas->line_px * atlas->line_px / 2 + atlas->tex_width - 1) / atlas->tex_width);
+    fs_GlyphLog *log = calloc(1, sizeof(fs_GlyphLog) + GLYPHS_EXTRA * atlas->phases * sizeof(fs_GlyphPatch));
+    assert(log);
+    log->y0            = atlas->tex_height;
+    atlas->tex_height += extra_rows + atlas->line_px;
+    log->pixels        = calloc((size_t)atlas->tex_width * (atlas->tex_height - log->y0), atlas->channels);
+    assert(log->pixels);
+    atlas->log = log;
+
+    // Font atlas, RGB for subpixel rendering or one channel for grayscale - rows tightly packed
+    image->pixels = calloc((size_t)atlas->tex_width * atlas->tex_height, atlas->channels);
+    assert(image->pixels);
+
+    // Paste all glyph bitmaps into the atlas
+    int ox = 0, oy = 0;
+    rowh = 0;
+
+    for (int i = 0; i < atlas->glyphs_baked; ++i) {
+        if (fs_load_glyph(atlas, face, FT_Get_Char_Index(face, i / atlas->phases + 32), i % atlas->phases)) {
+            fprintf(stderr, "Error: loading character %c failed\n", i / atlas->phases + 32);
+            continue;
+        }
+
+        unsigned int glyph_width = slot->bitmap.width / atlas->channels; // Adjust for RGB subpixel data
+        if (ox + glyph_width + 1 >= MAX_WIDTH) {
+            oy  += rowh;
+            rowh = 0;
+            ox   = 0;
+        }
+
+        for (unsigned int row = 0; row < slot->bitmap.rows; ++row) {
+            memcpy(image->pixels + ((size_t)(oy + row) * atlas->tex_width + ox) * atlas->channels, slot->bitmap.buffer + row * slot->bitmap.pitch,
+                   glyph_width * atlas->channels);
+        }
+
+        // Unhinted advance keeps 26.6 precision for subpixel positions
+        slots[i].advance_x     = atlas->phases > 1 ? ((slot->linearHoriAdvance + 512) >> 10) / 64.0f : slot->advance.x >> 6;
+        slots[i].bitmap_width  = glyph_width;
+        slots[i].bitmap_height = slot->bitmap.rows;
+        slots[i].bitmap_left   = slot->bitmap_left;
+        slots[i].bitmap_top    = slot->bitmap_top;
+        slots[i].offset_x      = ox;
+        slots[i].offset_y      = oy;
+
+        rowh = rowh > slot->bitmap.rows ? rowh : slot->bitmap.rows;
+        ox  += glyph_width + 1;
+    }
+
+#ifndef FS_TEXT_REFERENCE
+    // Gamma baked into coverage, the text shader skips pow()
+    unsigned char *gamma_lut = log->gamma_lut;
+    for (int v = 0; v < 256; ++v) {
+        gamma_lut[v] = lroundf(powf(v / 255.0f, 1.0f / atlas->gamma) * 255.0f);
+    }
+    for (size_t i = 0; i < (size_t)atlas->tex_width * log->y0 * atlas->channels; ++i) {
+        image->pixels[i] = gamma_lut[image->pixels[i]];
+    }
+#endif
+
+    // Glyph coordinates and metrics, two texels per slot as in fs_GlyphPatch - slots on demand start empty
+    GLfloat *tex_data = malloc(atlas->glyphs_num * 4 * 2 * sizeof(GLfloat));
+    assert(tex_data);
+    for (int i = 0; i < atlas->glyphs_num; i++) {
+        // The pixel coordinates of the bottom left corner, width and height of each glyph in the atlas
+        tex_data[8 * i + 0] = slots[i].offset_x / (float)atlas->tex_width;
+        tex_data[8 * i + 1] = slots[i].offset_y / (float)atlas->tex_height;
+        tex_data[8 * i + 2] = slots[i].bitmap_width / (float)atlas->tex_width;
+        tex_data[8 * i + 3] = slots[i].bitmap_height / (float)atlas->tex_height;
+        // Glyph metrics
+        tex_data[8 * i + 4] = slots[i].bitmap_left / (float)atlas->tex_width;
+        tex_data[8 * i + 5] = slots[i].bitmap_top / (float)atlas->tex_height;
+        tex_data[8 * i + 6] = slots[i].bitmap_width / (float)atlas->tex_width;
+        tex_data[8 * i + 7] = -slots[i].bitmap_height / (float)atlas->tex_height;
+    }
+    image->metrics = tex_data;
+
+    // Phase 0 metrics and packed advances for text measurement
+    for (int i = 0; i < GLYPHS_NUM; ++i) {
+        atlas->glyphs[i]       = slots[i * atlas->phases];
+        atlas->advance[i + 32] = lroundf(atlas->glyphs[i].advance_x * atlas->unit);
+    }
+    free(slots);
+
+    // Save kerning data if available - flat pair table of ASCII characters
+    atlas->kerning = calloc(KERN_DIM * KERN_DIM, sizeof(int16_t));
+    assert(atlas->kerning);
+    if (FT_HAS_KERNING(face)) {
+        FT_UInt glyph_index[KERN_DIM];
+        for (int c = 0; c < KERN_DIM; c++) {
+            glyph_index[c] = FT_Get_Char_Index(face, c);
+        }
+        // Populate kerning pairs
+        for (int c1 = 0; c1 < KERN_DIM; c1++) {
+            for (int c2 = 0; c2 < KERN_DIM; c2++) {
+                FT_Vector kerning;
+                // Get kerning value
+                if (FT_Get_Kerning(face, glyph_index[c1], glyph_index[c2], atlas->phases > 1 ? FT_KERNING_UNFITTED : FT_KERNING_DEFAULT, &kerning) != 0) {
+                    kerning.x = 0; // Error getting kerning for 'c1' and 'c2'
+                }
+                // Store kerning adjustment (in 26.6 fixed-point format, convert to units)
+                atlas->kerning[c1 * KERN_DIM + c2] = atlas->phases > 1 ? kerning.x : kerning.x >> 6;
+            }
+        }
+    }
+
+    // Baked glyphs are in the map, so shaped runs find them by glyph index
+    atlas->map = malloc(GLYPH_MAP * sizeof(fs_GlyphEntry));
+    assert(atlas->map);
+    memset(atlas->map, 0xFF, GLYPH_MAP * sizeof(fs_GlyphEntry));
+    for (int c = 32; c < 32 + GLYPHS_NUM; ++c) {
+        FT_UInt        index = FT_Get_Char_Index(face, c);
+        fs_GlyphEntry *entry = fs_map_entry(atlas->map, GLYPH_MAP, atlas->map_num, index);
+        if (entry->key == UINT32_MAX) {
+            entry->key     = index;
+            entry->slot    = (c - 32) * atlas->phases;
+            entry->advance = atlas->advance[c];
+            atlas->map_num++;
+        }
+    }
+
+#ifdef FS_USE_HARFBUZZ
+    // Unhinted advances with phases, as the packed advances
+    atlas->hb_font = hb_ft_font_create_referenced(face);
+    if (atlas->phases > 1) {
+        hb_ft_font_set_load_flags(atlas->hb_font, FT_LOAD_NO_HINTING);
+    }
+#endif
+
+    atlas->gpu_memory = (size_t)atlas->tex_width * atlas->tex_height * atlas->channels + atlas->glyphs_num * 2 * 4 * sizeof(GLfloat);
+    atlas->memory     = atlas->gpu_memory + KERN_DIM * KERN_DIM * sizeof(int16_t) + (GLYPH_MAP + COVER_MAP) * sizeof(fs_GlyphEntry) +
+                        sizeof(fs_GlyphLog) + GLYPHS_EXTRA * atlas->phases * sizeof(fs_GlyphPatch) +
+                        (size_t)atlas->tex_width * (atlas->tex_height - log->y0) * atlas->channels;
+
+    // Codepoints beyond ASCII are resolved on first use
+    atlas->cover = malloc(COVER_MAP * sizeof(fs_GlyphEntry));
+    assert(atlas->cover);
+    memset(atlas->cover, 0xFF, COVER_MAP * sizeof(fs_GlyphEntry));
+
+    // Face stays open for glyphs on demand
+    atlas->ft_lib      = ft_lib;
+    atlas->faces[0]    = face;
+    atlas->faces_tried = 1;
+    atlas->src         = src;
+    FS_PROFILE_END("fs_bake_atlas");
+    return (image);
+}
+
+static void fs_free_glyph_log(fs_GlyphLog *log)
+{
+    if (log) {
+        free(log->pixels);
+        free(log);
+    }
+}
+
+// Textures side of an atlas image, the log too unless the GL side took it
+static void fs_free_atlas_image(fs_AtlasImage *image)
+{
+    fs_free_glyph_log(image->atlas.log);
+    free(image->pixels);
+    free(image->metrics);
+    free(image);
+}
+
+// GL side: tracked binds, a bind of the bound object only counts as skipped
+static void fs_gl_program(fs_Context *ctx, GLuint program)
+{
+    if (ctx->gl.program == program) {
+        ctx->gl.skipped++;
+        return;
+    }
+    glUseProgram(program);
+    ctx->gl.program = program;
+    ctx->gl.changes++;
+}
+
+static void fs_gl_vao(fs_Context *ctx, GLuint vao)
+{
+    if (ctx->gl.vao == vao) {
+        ctx->gl.skipped++;
+        return;
+    }
+    glBindVertexArray(vao);
+    ctx->gl.vao = vao;
+    ctx->gl.changes++;
+}
+
+static void fs_gl_array_buffer(fs_Context *ctx, GLuint buffer)
+{
+    if (ctx->gl.array_buffer == buffer) {
+        ctx->gl.skipped++;
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    ctx->gl.array_buffer = buffer;
+    ctx->gl.changes++;
+}
+
+// Look up per draw uniform locations once, after linking
+static void fs_gl_uniforms(fs_Shader *shader)
+{
+    static const char *names[UNIFORMS_NUM] = { "res_atlas", "gamma", "metrics_base", "scale", "origin", "aligned", "rect" };
+    for (int i = 0; i < UNIFORMS_NUM; ++i) {
+        shader->uniform[i] = glGetUniformLocation(shader->program, names[i]);
+    }
+}
+
+// Set uniform of the bound program from n floats or one int, an unchanged value only counts as skipped
+static void fs_gl_uniform(fs_Context *ctx, fs_Shader *shader, UniformKind kind, const void *value, int n, int integer)
+{
+    if (shader->uniform[kind] == -1) {
+        return;
+    }
+    if (memcmp(shader->uniform_bits[kind], value, n * sizeof(uint32_t)) == 0) {
+        ctx->gl.skipped++;
+        return;
+    }
+    memcpy(shader->uniform_bits[kind], value, n * sizeof(uint32_t));
+    if (integer) {
+        glUniform1iv(shader->uniform[kind], 1, value);
+    } else if (n == 1) {
+        glUniform1fv(shader->uniform[kind], 1, value);
+    } else if (n == 2) {
+        glUniform2fv(shader->uniform[kind], 1, value);
+    } else {
+        glUniform4fv(shader->uniform[kind], 1, value);
+    }
+    ctx->gl.changes++;
+}
+
+// Bind texture to unit, target must be the one the unit is used for
+static void fs_gl_texture(fs_Context *ctx, int unit, GLenum target, GLuint texture)
+{
+    // Unit is switched even when bound, callers follow with calls on the target of this unit
+    if (ctx->gl.unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        ctx->gl.unit = unit;
+        ctx->gl.changes++;
+    }
+    if (ctx->gl.texture[unit] == texture) {
+        ctx->gl.skipped++;
+        return;
+    }
+    glBindTexture(target, texture);
+    ctx->gl.texture[unit] = texture;
+    ctx->gl.changes++;
+}
+
+// Deleting a bound texture unbinds it, and its name may come back from glGenTextures
+static void fs_gl_delete_texture(fs_Context *ctx, GLuint texture)
+{
+    for (int i = 0; i < 2; ++i) {
+        if (ctx->gl.texture[i] == texture) {
+            ctx->gl.texture[i] = 0;
+        }
+    }
+    glDeleteTextures(1, &texture);
+}
+
+// Pixel format of an atlas texture
+inline static GLenum fs_atlas_format(int channels)
+{
+    return (channels == 3 ? GL_RGB : GL_RED);
+}
+
+// GL side: replace textures of a font with baked image, image is consumed
+static void fs_upload_atlas(fs_Context *ctx, FontType type, fs_AtlasImage *image)
+{
+    fs_AtlasTex *tex    = &ctx->atlas_tex[type];
+    fs_Atlas    *atlas  = &image->atlas;
+    GLenum       format = fs_atlas_format(atlas->channels);
+    fs_gl_delete_texture(ctx, tex->tex_id);
+
+    // Texture unit 0: font atlas. GL_RGB for subpixel rendering, GL_R8 read as gray for grayscale.
+    glGenTextures(1, &tex->tex_id);
+    fs_gl_texture(ctx, 0, GL_TEXTURE_2D, tex->tex_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, atlas->channels == 3 ? GL_RGB8 : GL_R8, atlas->tex_width, atlas->tex_height, 0, format,
+                 GL_UNSIGNED_BYTE, image->pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (atlas->channels == 1) {
+        GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE }; // Same coverage on every channel, shaders are shared
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // Glyph coordinates and metrics into the range of the font in the shared buffer
+    glBindBuffer(GL_TEXTURE_BUFFER, ctx->text_shader.tbo_metrics);
+    glBufferSubData(GL_TEXTURE_BUFFER, tex->metrics_base * 4 * sizeof(GLfloat), atlas->glyphs_num * 2 * 4 * sizeof(GLfloat),
+                    image->metrics);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    tex->tex_width  = atlas->tex_width;
+    tex->tex_height = atlas->tex_height;
+    tex->channels   = atlas->channels;
+    tex->glyphs_num = atlas->glyphs_num;
+    tex->scale      = atlas->scale;
+    tex->gamma      = atlas->gamma;
+    tex->gen        = atlas->gen;
+
+    // Glyphs on demand of the old generation are never uploaded again
+    fs_free_glyph_log(tex->log);
+    tex->log         = atlas->log;
+    tex->applied     = 0;
+    image->atlas.log = NULL;
+    fs_free_atlas_image(image);
+}
+
+// GL side: upload glyphs rasterized on demand up to count the frame used
+static void fs_upload_glyphs(fs_Context *ctx, fs_AtlasTex *tex, int num)
+{
+    if (tex->applied >= num) {
+        return;
+    }
+    fs_GlyphLog *log = tex->log;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, tex->tex_width);
+    fs_gl_texture(ctx, 0, GL_TEXTURE_2D, tex->tex_id);
+    glBindBuffer(GL_TEXTURE_BUFFER, ctx->text_shader.tbo_metrics);
+    for (; tex->applied < num; ++tex->applied) {
+        fs_GlyphPatch *patch = &log->patches[tex->applied];
+        glTexSubImage2D(GL_TEXTURE_2D, 0, patch->x, patch->y, patch->width, patch->height, fs_atlas_format(tex->channels),
+                        GL_UNSIGNED_BYTE, log->pixels + ((size_t)(patch->y - log->y0) * tex->tex_width + patch->x) * tex->channels);
+        glBufferSubData(GL_TEXTURE_BUFFER, (tex->metrics_base + 2 * patch->slot) * 4 * sizeof(GLfloat), sizeof(patch->metrics),
+                        patch->metrics);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+// Main thread: switch layout metrics to baked image and queue its textures for the GL side
+static void fs_apply_atlas(fs_Context *ctx, FontType type, fs_AtlasImage *image)
+{
+    fs_free_atlas(&ctx->fonts[type]);
+    image->atlas.gen = ctx->fonts[type].gen + 1;
+    ctx->fonts[type] = image->atlas;
+    fs_invalidate_layers(ctx);
+
+    fs_AtlasImage *stale = fs_exchange_upload(&ctx->atlas_pending[type], image);
+    if (stale) {
+        fs_free_atlas_image(stale);
+    }
+}
+
+// GL side: upload atlases whose metrics the frame already uses
+static void fs_upload_pending(fs_Context *ctx, fs_Frame *frame)
+{
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        fs_AtlasImage *image = ctx->atlas_pending[i];
+        if (image && image->atlas.gen <= frame->atlas_gen[i]) {
+            fs_upload_atlas(ctx, i, fs_exchange_upload(&ctx->atlas_pending[i], NULL));
+        }
+        if (ctx->atlas_tex[i].gen == frame->atlas_gen[i]) {
+            fs_upload_glyphs(ctx, &ctx->atlas_tex[i], frame->glyph_patches[i]);
+        }
+    }
+}
+
+#ifdef FS_THREADS
+static int fs_bake_thread(void *arg)
+{
+    fs_Context *ctx = (fs_Context *)arg;
+#ifdef FS_PROFILE
+    fs_profile_tid = 2;
+#endif
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        ctx->rebuild.images[i] = fs_bake_atlas(&ctx->font_src[i], ctx->rebuild.scale);
+    }
+    atomic_store(&ctx->rebuild.done, 1);
+    glfwPostEmptyEvent();
+    return (0);
+}
+#endif
+
+// Rebuild atlases for new content scale, old atlases stay in use until all fonts are baked
+static void fs_rebuild_fonts(fs_Context *ctx)
+{
+    if (ctx->rebuild.running) {
+        ctx->rebuild.restart = 1;
+        return;
+    }
+    ctx->rebuild.scale   = ctx->scale;
+    ctx->rebuild.next    = 0;
+    ctx->rebuild.restart = 0;
+    ctx->rebuild.running = 1;
+#ifdef FS_THREADS
+    atomic_store(&ctx->rebuild.done, 0);
+    ctx->rebuild.threaded = thrd_create(&ctx->rebuild.thread, fs_bake_thread, ctx) == thrd_success;
+    if (!ctx->rebuild.threaded) {
+        fs_bake_thread(ctx); // No thread, bake in place
+    }
+#endif
+}
+
+// Called every fs_render_ui - finish background rebuild, without threads bake one font per call
+static void fs_rebuild_step(fs_Context *ctx)
+{
+    if (!ctx->rebuild.running) {
+        return;
+    }
+#ifdef FS_THREADS
+    if (!atomic_load(&ctx->rebuild.done)) {
+        return;
+    }
+    if (ctx->rebuild.threaded) {
+        thrd_join(ctx->rebuild.thread, NULL);
+    }
+#else
+    if (ctx->rebuild.next < FONTS_NUM) {
+        ctx->rebuild.images[ctx->rebuild.next] = fs_bake_atlas(&ctx->font_src[ctx->rebuild.next], ctx->rebuild.scale);
+        ctx->rebuild.next++;
+        ctx->sched.animating = 1; // Keep polling until all fonts are baked
+        return;
+    }
+#endif
+    ctx->rebuild.running = 0;
+
+    // Scale changed again meanwhile - bake again
+    int stale = ctx->rebuild.restart || ctx->rebuild.scale != ctx->scale;
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        fs_AtlasImage *image = ctx->rebuild.images[i];
+        if (image && stale) {
+            fs_free_atlas(&image->atlas);
+            fs_free_atlas_image(image);
+        } else if (image) {
+            fs_apply_atlas(ctx, i, image);
+        }
+        ctx->rebuild.images[i] = NULL;
+    }
+    if (stale) {
+        fs_rebuild_fonts(ctx);
+    }
+    fs_invalidate(ctx);
+}
+
+static void fs_init_fonts(fs_Context *ctx, fs_Fonts *fonts)
+{
+    FS_PROFILE_BEGIN("fs_init_fonts");
+    // Metrics of all fonts in one texture buffer on unit 1, bound once - slot counts do not change with rebuilds
+    int texels = 0;
+    for (FontType type = 0; type < FONTS_NUM; ++type) {
+        ctx->font_src[type]               = fonts[type];
+        ctx->atlas_tex[type].metrics_base = texels;
+        texels                           += 2 * fs_glyph_slots(&fonts[type]);
+    }
+    fs_Shader *shader = &ctx->text_shader;
+    glDeleteBuffers(1, &shader->tbo_metrics);
+    fs_gl_delete_texture(ctx, shader->tex_metrics);
+    glGenBuffers(1, &shader->tbo_metrics);
+    glBindBuffer(GL_TEXTURE_BUFFER, shader->tbo_metrics);
+    glBufferData(GL_TEXTURE_BUFFER, texels * 4 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &shader->tex_metrics);
+    fs_gl_texture(ctx, 1, GL_TEXTURE_BUFFER, shader->tex_metrics);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, shader->tbo_metrics);
+
+    for (FontType type = 0; type < FONTS_NUM; ++type) {
+        fs_AtlasImage *image = fs_bake_atlas(&ctx->font_src[type], ctx->scale);
+        if (image == NULL) {
+            exit(1);
+        }
+        // GL context is still on this thread
+        fs_apply_atlas(ctx, type, image);
+        fs_upload_atlas(ctx, type, fs_exchange_upload(&ctx->atlas_pending[type], NULL));
+    }
+    FS_PROFILE_END("fs_init_fonts");
+}
+
+// Atlas memory per font - trade atlas size for subpixel positioning quality. Totals match the Fonts line of fs_memory_report.
+static void fs_font_memory_report(fs_Context *ctx)
+{
+    size_t gpu = 0, cpu = 0;
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        fs_Atlas *atlas = &ctx->fonts[i];
+        printf("Font %d: phases %d, %s atlas %ux%u, GPU %zu bytes, CPU %zu bytes\n", i, atlas->phases, atlas->channels == 3 ? "LCD" : "gray",
+               atlas->tex_width, atlas->tex_height, atlas->gpu_memory, atlas->memory - atlas->gpu_memory);
+        gpu += atlas->gpu_memory;
+        cpu += atlas->memory - atlas->gpu_memory;
+    }
+    printf("Fonts total: GPU %zu bytes, CPU %zu bytes\n", gpu, cpu);
+}
+
+static void fs_error_callback(int error, const char *description)
+{
+    fprintf(stderr, "Error: %s (%d)\n", description, error);
+}
+
+static void fs_on_char(fs_Context *ctx, unsigned int codepoint)
+{
+    if (ctx->inputbox.boxes[ctx->screen].selected == NO_SIGNAL) {
+        return;
+    }
+    fs_invalidate(ctx);
+    fs_Box *box = fs_box_vector_at(&ctx->inputbox.boxes[ctx->screen].box, ctx->inputbox.boxes[ctx->screen].selected);
+
+    // Clear inputbox if double clicked
+    if (ctx->double_click == GLFW_TRUE) {
+        memset(box->text, 0, MAX_LEN + 1);
+        box->len_char     = 0;
+        box->len_pixel    = 0;
+        ctx->double_click = GLFW_FALSE;
+    }
+
+    // Character check in numeric inputbox
+    if (box->flag == NUM && !((codepoint >= '0' && codepoint <= '9') || codepoint == '.' || codepoint == '-')) {
+        return;
+    }
+
+    // Check string length, typed characters are stored as UTF-8
+    char utf8[4];
+    int  bytes = codepoint < 32 ? 0 : fs_utf8_encode(codepoint, utf8);
+    if (bytes == 0 || box->len_char + bytes > MAX_LEN - 1) {
+        return;
+    }
+
+    // Check glyph in atlas or fallback faces
+    const unsigned char *c        = (const unsigned char *)utf8;
+    unsigned char        previous = 32;
+    int                  kerning, advance;
+    if (box->len_char > 0 && (unsigned char)box->text[box->len_char - 1] < 0x80) {
+        previous = box->text[box->len_char - 1];
+    }
+    if (fs_next_glyph(&ctx->fonts[BOX], &c, &previous, &kerning, &advance) == NO_SIGNAL) {
+        return;
+    }
+
+    // Check pixel width
+    float width = (float)(advance + kerning) / (ctx->fonts[BOX].unit * ctx->fonts[BOX].scale);
+    if (box->len_pixel + PADDING + width > ctx->inputbox.boxes[ctx->screen].geom.w[ctx->inputbox.boxes[ctx->screen].selected]) {
+        return;
+    }
+
+    // Check if text is valid floating point number in numeric inputbox
+    memcpy(box->text + box->len_char, utf8, bytes);
+    box->text[box->len_char + bytes] = '\0';
+    if (strcmp(box->text, "-") != 0 && box->flag == NUM) { // Negative sign is valid
+        char   *pEnd;
+        double value = strtod(box->text, &pEnd);
+        if (pEnd == box->text || *pEnd != '\0') {
+            box->text[box->len_char] = '\0';
+            return;
+        }
+    }
+
+    // All good, add character
+    box->len_char  += bytes;
+    box->len_pixel += width;
+}
+
+static void fs_on_key(fs_Context *ctx, int key, int action, int mods)
+{
+    if (GLFW_PRESS != action && GLFW_REPEAT != action) {
+        return;
+    }
+
+    fs_Box *box = NULL;
+    fs_invalidate(ctx);
+    if (ctx->inputbox.boxes[ctx->screen].selected == NO_SIGNAL) {
+        box = fs_box_vector_at(&ctx->inputbox.boxes[ctx->screen].box, 0);
+    } else {
+        box = fs_box_vector_at(&ctx->inputbox.boxes[ctx->screen].box, ctx->inputbox.boxes[ctx->screen].selected);
     }
 
     switch (key) {
@@ -450,678 +2667,2508 @@ static void fs_key_callback(GLFWwindow *window, int key, int scancode, int actio
             glfwSetWindowShouldClose(ctx->window, GL_TRUE);
         break;
 
-        case GLFW_KEY_BACKSPACE:
-            if (ctx->inputbox.boxes[ctx->screen].selected != NO_SIGNAL && box->len_char > 0) {
-                if (ctx->double_click == GLFW_TRUE) {
-                    memset(box->text, 0, MAX_LEN + 1);
-                    box->len_char  = 0;
-                    box->len_pixel = PADDING;
-                } else {
-                    box->len_char--;
-                    box->text[box->len_char] = '\0';
-                    box->len_pixel           = PADDING + fs_text_width(&ctx->fonts[BOX], box->text);
-                }
-                ctx->double_click = GLFW_FALSE;
-            }
+        case GLFW_KEY_BACKSPACE:
+            if (ctx->inputbox.boxes[ctx->screen].selected != NO_SIGNAL && box->len_char > 0) {
+                if (ctx->double_click == GLFW_TRUE) {
+                    memset(box->text, 0, MAX_LEN + 1);
+                    box->len_char  = 0;
+                    box->len_pixel = PADDING;
+                } else {
+                    do {
+                        box->len_char--; // Whole character, continuation bytes first
+                    } while (box->len_char > 0 && ((unsigned char)box->text[box->len_char] & 0xC0) == 0x80);
+                    box->text[box->len_char] = '\0';
+                    box->len_pixel           = PADDING + fs_text_width(&ctx->fonts[BOX], box->text);
+                }
+                ctx->double_click = GLFW_FALSE;
+            }
+        break;
+
+        case GLFW_KEY_TAB:
+            if (mods == GLFW_MOD_SHIFT) {
+                if (ctx->inputbox.boxes[ctx->screen].selected > 0) {
+                    ctx->inputbox.boxes[ctx->screen].selected--;
+                } else {
+                    ctx->inputbox.boxes[ctx->screen].selected = ctx->inputbox.boxes[ctx->screen].box.size - 1;
+                }
+            } else {
+                if (ctx->inputbox.boxes[ctx->screen].selected < ctx->inputbox.boxes[ctx->screen].box.size - 1) {
+                    ctx->inputbox.boxes[ctx->screen].selected++;
+                } else {
+                    ctx->inputbox.boxes[ctx->screen].selected = 0;
+                }
+            }
+            ctx->double_click = GLFW_FALSE;
+        break;
+
+        case GLFW_KEY_ENTER:
+            ctx->inputbox.boxes[ctx->screen].commited = GLFW_TRUE;
+        break;
+    }
+
+    if ((GLFW_MOD_CONTROL & mods) == 0 || ctx->inputbox.boxes[ctx->screen].selected == NO_SIGNAL) {
+        return;
+    }
+
+    switch (key) {
+        case GLFW_KEY_V:
+            // Basic clipboad checks
+            const char *cb = glfwGetClipboardString(ctx->window);
+            if (cb == NULL || *cb == '\r' || *cb == '\n') {
+                return;
+            }
+
+            // Remove new lines and subsequent characters
+            for (unsigned char *p = (unsigned char *)cb; *p; ++p) {
+                if (*p == '\r' || *p == '\n') {
+                    *p = '\0';
+                    break;
+                }
+            }
+
+            // Text in clipboard valid for numeric inputbox?
+            if (box->flag == NUM) {
+                char   *pEnd;
+                double value = strtod(cb, &pEnd);
+                if (pEnd == cb || *pEnd != '\0') {
+                    return;
+                }
+            }
+
+            // Calculate number of characters to paste, whole UTF-8 characters only
+            char buf[MAX_LEN + 1] = { 0 };
+            int  copy_len         = 0;
+
+            for (const unsigned char *p = (const unsigned char *)cb, *next; *p; p = next) {
+                next = p;
+                fs_utf8_next(&next);
+                int bytes = (int)(next - p);
+                if (copy_len + bytes > MAX_LEN - 1) {
+                    break;
+                }
+                memcpy(buf + copy_len, p, bytes);
+                float width = fs_text_width(&ctx->fonts[BOX], buf) + PADDING;
+                if (width > ctx->inputbox.boxes[ctx->screen].geom.w[ctx->inputbox.boxes[ctx->screen].selected]) {
+                    memset(buf + copy_len, 0, bytes);
+                    break;
+                }
+                copy_len += bytes;
+            }
+            ctx->double_click = GLFW_FALSE;
+            fs_set_inputbox_content(ctx, ctx->inputbox.boxes[ctx->screen].selected, buf);
+        break;
+
+        case GLFW_KEY_C:
+            fs_Box *box = fs_box_vector_at(&ctx->inputbox.boxes[ctx->screen].box, ctx->inputbox.boxes[ctx->screen].selected);
+            glfwSetClipboardString(ctx->window, box->text);
+        break;
+    }
+}
+
+static void fs_on_button(fs_Context *ctx, int btn_m, int action, double time)
+{
+    if (btn_m != GLFW_MOUSE_BUTTON_LEFT) {
+        return;
+    }
+    if (action == GLFW_PRESS) {
+        fs_invalidate(ctx);
+        // Any button clicked? The topmost (last added) wins
+        float ypos = ctx->my + ctx->scroll.offset / 2.0f;
+        int   hit  = fs_geometry_hit_last(&ctx->buttons.geom, ctx->mx, ypos);
+        if (hit != NO_SIGNAL) {
+            ctx->buttons.clicked = hit;
+        }
+
+        // Any inputbox clicked or double-clicked?
+        hit = fs_geometry_hit_first(&ctx->inputbox.boxes[ctx->screen].geom, ctx->mx, ypos);
+        if (hit != NO_SIGNAL) {
+            ctx->inputbox.boxes[ctx->screen].selected = hit;
+            float dt = time - ctx->last_click;
+            if (dt > CLICK_LO && dt < CLICK_HI) {
+                ctx->double_click = GLFW_TRUE;
+            } else {
+                ctx->double_click = GLFW_FALSE;
+            }
+            ctx->last_click = time;
+        }
+    }
+}
+
+// Advance scroll animation to time now, returns 1 while still moving
+static int fs_scroll_update(fs_Context *ctx, double now)
+{
+    fs_Scroll *scroll = &ctx->scroll;
+    float      dt     = scroll->time > 0 ? now - scroll->time : 0;
+    int        moving = 0;
+    scroll->time = now;
+
+    // Scroll only downwards and no scroll if objects fit in window size
+    float limit = 2.0f * (scroll->max + PADDING - ctx->height);
+    limit = limit > 0 ? limit : 0;
+
+    if (scroll->mode == SCROLL_SMOOTH) {
+        scroll->target  = scroll->target < 0 ? 0 : (scroll->target > limit ? limit : scroll->target);
+        scroll->offset += (scroll->target - scroll->offset) * (1.0f - expf(-dt / SCROLL_EASE));
+        if (fabsf(scroll->target - scroll->offset) < 0.5f) {
+            scroll->offset = scroll->target;
+        }
+        moving = scroll->offset != scroll->target;
+    } else {
+        // Exact integral of exponentially decaying velocity over dt
+        float decay       = expf(-dt / SCROLL_DECAY);
+        scroll->offset   += scroll->velocity * SCROLL_DECAY * (1.0f - decay);
+        scroll->velocity *= decay;
+        if (fabsf(scroll->velocity) < SCROLL_STOP) {
+            scroll->velocity = 0;
+        }
+        moving = scroll->velocity != 0;
+    }
+
+    if (scroll->offset <= 0 || scroll->offset >= limit) {
+        scroll->offset   = scroll->offset <= 0 ? 0 : limit;
+        scroll->velocity = 0;
+        moving           = scroll->mode == SCROLL_SMOOTH && scroll->offset != scroll->target;
+    }
+    return (moving);
+}
+
+static void fs_set_scroll_mode(fs_Context *ctx, ScrollMode mode)
+{
+    ctx->scroll.mode     = mode;
+    ctx->scroll.velocity = 0;
+    ctx->scroll.target   = ctx->scroll.offset;
+}
+
+static void fs_on_scroll(fs_Context *ctx, double offsetY, double time)
+{
+    fs_scroll_update(ctx, time > ctx->scroll.time ? time : ctx->scroll.time);
+    if (ctx->scroll.mode == SCROLL_SMOOTH) {
+        ctx->scroll.target -= offsetY * SCROLL_STEP;
+    } else {
+        ctx->scroll.offset  -= offsetY * ACC_Y;
+        ctx->scroll.velocity = -((offsetY > 0) - (offsetY < 0)) * SCROLL_SPEED;
+    }
+    ctx->sched.animating = 1;
+    fs_invalidate(ctx);
+}
+
+static void fs_on_cursor(fs_Context *ctx, double xpos, double ypos)
+{
+    ctx->mx = xpos * ctx->cursor_scale;
+    ctx->my = ypos * ctx->cursor_scale;
+
+    // Redraw only if hovered button changes or a hover box follows the cursor
+    float x      = ctx->mx;
+    float y      = ctx->my + ctx->scroll.offset / 2.0f;
+    int   button = fs_geometry_hit_last(&ctx->buttons.geom, x, y);
+    int   area   = fs_geometry_hit_first(&ctx->areas.geom, x, y);
+    if (button != ctx->sched.hover_button || area != NO_SIGNAL || area != ctx->sched.hover_area) {
+        fs_invalidate(ctx);
+    }
+    ctx->sched.hover_button = button;
+    ctx->sched.hover_area   = area;
+}
+
+static void fs_apply_event(fs_Context *ctx, const fs_Event *ev)
+{
+    switch (ev->kind) {
+        case INPUT_CHAR:   fs_on_char(ctx, ev->code); break;
+        case INPUT_KEY:    fs_on_key(ctx, ev->code, ev->action, ev->mods); break;
+        case INPUT_BUTTON: fs_on_button(ctx, ev->code, ev->action, ev->time); break;
+        case INPUT_SCROLL: fs_on_scroll(ctx, ev->y, ev->time); break;
+        case INPUT_CURSOR: fs_on_cursor(ctx, ev->x, ev->y); break;
+        default: break;
+    }
+}
+
+// Apply queued input in arrival order, runs of scroll events are summed and runs of cursor events keep the last position
+static void fs_input_drain(fs_Context *ctx)
+{
+    fs_Input *in = &ctx->input;
+    if (in->head == in->tail) {
+        return;
+    }
+    FS_PROFILE_BEGIN("fs_input_drain");
+
+    while (in->head != in->tail) {
+        fs_Event *ev     = &in->events[in->head++ & (INPUT_QUEUE - 1)];
+        int       count  = 1;
+        double    sum    = ev->time;
+        double    oldest = ev->time;
+        while ((ev->kind == INPUT_SCROLL || ev->kind == INPUT_CURSOR) && in->head != in->tail) {
+            fs_Event *next = &in->events[in->head & (INPUT_QUEUE - 1)];
+            if (next->kind != ev->kind) {
+                break;
+            }
+            if (ev->kind == INPUT_SCROLL) {
+                next->x += ev->x;
+                next->y += ev->y;
+            }
+            in->coalesced[ev->kind]++;
+            count++;
+            sum += next->time;
+            ev   = next;
+            in->head++;
+        }
+        // Latency counts only for events that request a frame themselves, not those landing in one already due
+        int dirty        = ctx->sched.dirty;
+        ctx->sched.dirty = 0;
+        fs_apply_event(ctx, ev);
+        int shown         = ctx->sched.dirty;
+        ctx->sched.dirty |= dirty;
+        if (!shown) {
+            in->idle[ev->kind] += count;
+            continue;
+        }
+        if (in->pending[ev->kind] == 0) {
+            in->pending_oldest[ev->kind] = oldest;
+        }
+        in->pending[ev->kind]     += count;
+        in->pending_sum[ev->kind] += sum;
+    }
+    FS_PROFILE_END("fs_input_drain");
+}
+
+// A full queue is applied right away as the callbacks did before
+static void fs_input_queue(fs_Context *ctx, const fs_Event *ev)
+{
+    fs_Input *in = &ctx->input;
+    if (in->tail - in->head == INPUT_QUEUE) {
+        in->overflows++;
+        fs_input_drain(ctx);
+    }
+    in->events[in->tail++ & (INPUT_QUEUE - 1)] = *ev;
+    in->received[ev->kind]++;
+}
+
+static void fs_record_write(fs_Replay *rp, const fs_Event *ev)
+{
+    uint64_t us    = (uint64_t)llround((ev->time - rp->start) * 1e6);
+    uint64_t delta = us > rp->last ? us - rp->last : 0;
+    delta          = delta < UINT32_MAX ? delta : UINT32_MAX;
+    fs_Record rec  = { (uint32_t)delta, ev->kind, ev->action, ev->mods, 0, ev->code, ev->x, ev->y };
+    rp->last      += delta;
+    rp->records++;
+    fwrite(&rec, sizeof(rec), 1, rp->fp);
+}
+
+// Queue event with its arrival time, real input is ignored while a recording is replayed
+static void fs_input_push(fs_Context *ctx, fs_Event ev)
+{
+    if (ctx->replay.events) {
+        return;
+    }
+    ev.time = glfwGetTime();
+    if (ctx->replay.fp) {
+        fs_record_write(&ctx->replay, &ev);
+    }
+    fs_input_queue(ctx, &ev);
+}
+
+// Frame with the pending events is out - with FS_RENDER_THREAD that is when it is handed to the GL thread
+static void fs_input_presented(fs_Context *ctx, double present)
+{
+    fs_Input *in     = &ctx->input;
+    double    oldest = present;
+    for (int k = 0; k < INPUT_KINDS; ++k) {
+        if (in->pending[k] == 0) {
+            continue;
+        }
+        double worst = present - in->pending_oldest[k];
+        in->presented[k]   += in->pending[k];
+        in->latency_sum[k] += in->pending[k] * present - in->pending_sum[k];
+        if (worst > in->latency_max[k]) {
+            in->latency_max[k] = worst;
+        }
+        if (in->pending_oldest[k] < oldest) {
+            oldest = in->pending_oldest[k];
+        }
+        in->pending[k]     = 0;
+        in->pending_sum[k] = 0;
+    }
+    if (oldest < present) {
+        in->latency_last = present - oldest;
+    }
+}
+
+static void fs_input_report(fs_Context *ctx)
+{
+    static const char *names[INPUT_KINDS] = { "char", "key", "button", "scroll", "cursor" };
+    fs_Input *in = &ctx->input;
+    for (int k = 0; k < INPUT_KINDS; ++k) {
+        double avg = in->presented[k] > 0 ? in->latency_sum[k] / in->presented[k] : 0;
+        printf("Input %-6s: %lu received, %lu coalesced, %lu idle, latency avg %.2f ms, max %.2f ms\n", names[k], in->received[k],
+               in->coalesced[k], in->idle[k], avg * 1000.0, in->latency_max[k] * 1000.0);
+    }
+    printf("Input: last frame latency %.2f ms, %lu queue overflows\n", in->latency_last * 1000.0, in->overflows);
+}
+
+// GLFW callbacks only queue the event, fs_render_ui applies it
+static void fs_char_callback(GLFWwindow *window, unsigned int codepoint)
+{
+    fs_input_push((fs_Context *)glfwGetWindowUserPointer(window), (fs_Event){ .kind = INPUT_CHAR, .code = codepoint });
+}
+
+static void fs_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    fs_input_push((fs_Context *)glfwGetWindowUserPointer(window), (fs_Event){ .kind = INPUT_KEY, .code = key, .action = action, .mods = mods });
+}
+
+static void fs_button_callback(GLFWwindow *window, int btn_m, int action, int mods)
+{
+    fs_input_push((fs_Context *)glfwGetWindowUserPointer(window), (fs_Event){ .kind = INPUT_BUTTON, .code = btn_m, .action = action, .mods = mods });
+}
+
+static void fs_scroll_callback(GLFWwindow *window, double offsetX, double offsetY)
+{
+    fs_input_push((fs_Context *)glfwGetWindowUserPointer(window), (fs_Event){ .kind = INPUT_SCROLL, .x = offsetX, .y = offsetY });
+}
+
+static void fs_cursor_callback(GLFWwindow *window, double xpos, double ypos)
+{
+    fs_input_push((fs_Context *)glfwGetWindowUserPointer(window), (fs_Event){ .kind = INPUT_CURSOR, .x = xpos, .y = ypos });
+}
+
+static void fs_refresh_callback(GLFWwindow *window)
+{
+    fs_invalidate((fs_Context *)glfwGetWindowUserPointer(window));
+}
+
+// Logical size is framebuffer size over content scale, atlases follow the content scale
+static void fs_update_scale(fs_Context *ctx)
+{
+    int   win_width, win_height;
+    float xscale, yscale;
+    glfwGetWindowSize(ctx->window, &win_width, &win_height);
+    glfwGetFramebufferSize(ctx->window, &ctx->fb_width, &ctx->fb_height);
+    glfwGetWindowContentScale(ctx->window, &xscale, &yscale);
+
+    float scale       = xscale > 0 ? xscale : 1.0f;
+    ctx->width        = lroundf(ctx->fb_width / scale);
+    ctx->height       = lroundf(ctx->fb_height / scale);
+    ctx->cursor_scale = win_width > 0 ? ctx->fb_width / (float)win_width / scale : 1.0f;
+    if (scale != ctx->scale) {
+        ctx->scale = scale;
+        fs_invalidate_layers(ctx); // Layer textures are framebuffer pixels, window size does not matter
+        if (ctx->fonts[0].scale > 0) {
+            fs_rebuild_fonts(ctx); // Fonts loaded
+        }
+    }
+    fs_invalidate(ctx);
+}
+
+static void fs_resize_callback(GLFWwindow *window, int width, int height)
+{
+    fs_Context *ctx = (fs_Context *)glfwGetWindowUserPointer(window);
+    if (ctx->replay.fp) {
+        int win_width, win_height;
+        glfwGetWindowSize(window, &win_width, &win_height);
+        fs_record_write(&ctx->replay, &(fs_Event){ .time = glfwGetTime(), .kind = RECORD_RESIZE, .x = win_width, .y = win_height });
+    }
+    fs_update_scale(ctx);
+}
+
+static void fs_scale_callback(GLFWwindow *window, float xscale, float yscale)
+{
+    fs_update_scale((fs_Context *)glfwGetWindowUserPointer(window));
+}
+
+#ifdef FS_PROFILE
+// Profiled wrappers registered in place of the GLFW callbacks
+static void fs_error_callback_profiled(int error, const char *description)
+{
+    FS_PROFILE_BEGIN("fs_error_callback");
+    fs_error_callback(error, description);
+    FS_PROFILE_END("fs_error_callback");
+}
+
+static void fs_char_callback_profiled(GLFWwindow *window, unsigned int codepoint)
+{
+    FS_PROFILE_BEGIN("fs_char_callback");
+    fs_char_callback(window, codepoint);
+    FS_PROFILE_END("fs_char_callback");
+}
+
+static void fs_key_callback_profiled(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    FS_PROFILE_BEGIN("fs_key_callback");
+    fs_key_callback(window, key, scancode, action, mods);
+    FS_PROFILE_END("fs_key_callback");
+}
+
+static void fs_button_callback_profiled(GLFWwindow *window, int btn_m, int action, int mods)
+{
+    FS_PROFILE_BEGIN("fs_button_callback");
+    fs_button_callback(window, btn_m, action, mods);
+    FS_PROFILE_END("fs_button_callback");
+}
+
+static void fs_scroll_callback_profiled(GLFWwindow *window, double offsetX, double offsetY)
+{
+    FS_PROFILE_BEGIN("fs_scroll_callback");
+    fs_scroll_callback(window, offsetX, offsetY);
+    FS_PROFILE_END("fs_scroll_callback");
+}
+
+static void fs_resize_callback_profiled(GLFWwindow *window, int width, int height)
+{
+    FS_PROFILE_BEGIN("fs_resize_callback");
+    fs_resize_callback(window, width, height);
+    FS_PROFILE_END("fs_resize_callback");
+}
+
+static void fs_scale_callback_profiled(GLFWwindow *window, float xscale, float yscale)
+{
+    FS_PROFILE_BEGIN("fs_scale_callback");
+    fs_scale_callback(window, xscale, yscale);
+    FS_PROFILE_END("fs_scale_callback");
+}
+
+static void fs_cursor_callback_profiled(GLFWwindow *window, double xpos, double ypos)
+{
+    FS_PROFILE_BEGIN("fs_cursor_callback");
+    fs_cursor_callback(window, xpos, ypos);
+    FS_PROFILE_END("fs_cursor_callback");
+}
+
+static void fs_refresh_callback_profiled(GLFWwindow *window)
+{
+    FS_PROFILE_BEGIN("fs_refresh_callback");
+    fs_refresh_callback(window);
+    FS_PROFILE_END("fs_refresh_callback");
+}
+#endif // FS_PROFILE
+
+static void fs_add_area(fs_Context *ctx, vec4 pos, void *callback_fn)
+{
+    fs_Area *area = fs_area_vector_push(&ctx->areas.area);
+    if (area == NULL) {
+        return;
+    }
+
+    if (!fs_geometry_add(&ctx->areas.geom, pos)) {
+        ctx->areas.area.size--;
+        return;
+    }
+
+    memset(area, 0, sizeof(fs_Area));
+    area->func = callback_fn;
+    fs_invalidate(ctx);
+}
+
+// Rectangle with gradient, border or rounded corners
+// Rects and texts added until fs_end_layer are rendered once into a texture and drawn below all other
+// elements. Layers are opaque with the window background. Pass NO_SIGNAL for a new layer, or the index
+// of a layer to replace its content. Returns layer index, NO_SIGNAL if all LAYERS_NUM are used.
+static int fs_begin_layer(fs_Context *ctx, int index)
+{
+    fs_Layers *layers = &ctx->layers;
+    if (index == NO_SIGNAL) {
+        if (layers->num == LAYERS_NUM) {
+            return (NO_SIGNAL); // Elements are drawn every frame instead
+        }
+        index = layers->num++;
+    }
+    assert(index >= 0 && index < layers->num);
+
+    fs_Layer *layer = &layers->layer[index];
+    fs_rect_vector_clear(&layer->rects.rect);
+    layer->rects.geom.size = 0;
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        fs_text_vector_clear(&layer->texts[i].text);
+    }
+    layer->version = ++layers->serial;
+    layers->open   = index;
+    fs_invalidate(ctx);
+    return (index);
+}
+
+static void fs_end_layer(fs_Context *ctx)
+{
+    ctx->layers.open = NO_SIGNAL;
+}
+
+static void fs_add_rect_style(fs_Context *ctx, vec4 pos, fs_Style style)
+{
+    fs_Rects *rects = ctx->layers.open != NO_SIGNAL ? &ctx->layers.layer[ctx->layers.open].rects : &ctx->rects;
+    fs_Rect  *rect  = fs_rect_vector_push(&rects->rect);
+    if (rect == NULL) {
+        return;
+    }
+
+    if (!fs_geometry_add(&rects->geom, pos)) {
+        rects->rect.size--;
+        return;
+    }
+
+    rect->style = style;
+    fs_invalidate(ctx);
+}
+
+static void fs_add_rect(fs_Context *ctx, vec4 pos, vec4 col)
+{
+    fs_add_rect_style(ctx, pos, fs_style(col));
+}
+
+// Text of len bytes, paragraph rows are not capped at MAX_LEN - breaks and ellipses add to the source text
+static void fs_push_text(fs_Context *ctx, vec2 pos, const char *text, size_t len, FontType type, vec4 fg_col, Align alignment)
+{
+    fs_Arena *arena = (type == BOX || type == HOVER) ? &ctx->frame_arena : &ctx->arena;
+    fs_Texts *texts = &ctx->texts[type];
+    if (ctx->layers.open != NO_SIGNAL && type != BOX && type != HOVER) {
+        texts = &ctx->layers.layer[ctx->layers.open].texts[type];
+    }
+    fs_Text *txt = fs_text_vector_push(&texts->text);
+    if (txt == NULL) {
+        return;
+    }
+
+    switch (alignment) {
+        case ALIGN_CENTER:
+            pos[0] -= fs_run_width(ctx, type, text) / 2.0f;
+        break;
+
+        case ALIGN_RIGHT:
+            pos[0] -= fs_run_width(ctx, type, text);
+        break;
+
+        default:
         break;
+    }
+
+    txt->text = fs_arena_str(arena, text, len);
+    fs_vec4_copy(txt->col, fg_col);
+    fs_vec2_copy(txt->pos, pos);
+    fs_invalidate(ctx);
+}
+
+static void fs_add_text(fs_Context *ctx, vec2 pos, char *text, FontType type, vec4 fg_col, Align alignment)
+{
+    fs_push_text(ctx, pos, text, fs_utf8_cut(text, strlen(text), MAX_LEN), type, fg_col, alignment);
+}
+
+// Text in rect x, y, w, h, rows wrapped or cut at width w and dropped below height h - 0 for no limit.
+// Line breaks are cached per font, string and rect size, so an unchanged paragraph is laid out once.
+static void fs_add_paragraph(fs_Context *ctx, vec4 rect, char *text, FontType type, vec4 fg_col, Align alignment, int flags)
+{
+    fs_Atlas *atlas    = &ctx->fonts[type];
+    int       max_rows = rect[3] > 0 ? (int)(rect[3] / atlas->line_height) : 0;
+    if (rect[3] > 0 && max_rows == 0) {
+        return;
+    }
+    fs_Run *run = fs_run_find(ctx, type, text, rect[2], max_rows, flags);
+    if (run == NULL) {
+        return;
+    }
+
+    // First baseline one row below top, as text blocks in layers and hover boxes
+    vec2 pos = { rect[0], rect[1] + atlas->line_height };
+    if (alignment == ALIGN_LEFT) {
+        fs_push_text(ctx, pos, run->lines, strlen(run->lines), type, fg_col, ALIGN_LEFT);
+        return;
+    }
+
+    // Aligned rows are separate texts - copy first, their lookups may evict the paragraph
+    char lines[4 * (MAX_LEN + 1)];
+    strcpy(lines, run->lines);
+    pos[0] += alignment == ALIGN_CENTER ? rect[2] / 2.0f : rect[2];
+    for (char *row = lines, *end; row != NULL; row = end ? end + 1 : NULL) {
+        end = strchr(row, '\n');
+        if (end != NULL) {
+            *end = '\0';
+        }
+        fs_push_text(ctx, (vec2){ pos[0], pos[1] }, row, strlen(row), type, fg_col, alignment);
+        pos[1] += atlas->line_height;
+    }
+}
+
+static void fs_add_area_text(fs_Context *ctx, char *text, vec4 fg_col)
+{
+    fs_Atlas *atlas = &ctx->fonts[HOVER];
+    fs_Run   *run   = fs_run_find(ctx, HOVER, text, HOVER_WIDTH, 0, TEXT_WRAP);
+    if (run == NULL) {
+        return;
+    }
+    int rows = run->rows + 3; // Min 1 row and 1 + 1 extra blank row at top and bottom
+
+    fs_Area *area  = fs_area_vector_at(&ctx->areas.area, ctx->areas.active);
+    float   ypos   = ctx->my + ctx->scroll.offset / 2.0f;
+    vec4    bg_pos = { ctx->mx, ypos, run->width + atlas->line_height * 2.0f, rows * atlas->line_height };
+    fs_vec4_copy(area->text_pos, bg_pos);
+    fs_add_paragraph(ctx, (vec4){ ctx->mx + atlas->line_height, ypos + atlas->line_height, HOVER_WIDTH, 0 }, text, HOVER, fg_col, ALIGN_LEFT,
+                     TEXT_WRAP);
+}
+
+static int fs_check_area(fs_Context *ctx)
+{
+    FS_PROFILE_BEGIN("fs_check_area");
+    float ypos = ctx->my + ctx->scroll.offset / 2.0f;
+    int   hit  = 0;
+
+    int i = fs_geometry_hit_first(&ctx->areas.geom, ctx->mx, ypos);
+    if (i != NO_SIGNAL) {
+        fs_Area *hover    = fs_area_vector_at(&ctx->areas.area, i);
+        ctx->areas.active = i;
+        hover->func(ctx);
+        hit = 1;
+    }
+
+    FS_PROFILE_END("fs_check_area");
+    return (hit);
+}
+
+static void fs_add_button(fs_Context *ctx, vec4 pos, char *text, FontType type)
+{
+    fs_Button *btn = fs_button_vector_push(&ctx->buttons.button);
+    if (btn == NULL) {
+        return;
+    }
+    if (!fs_geometry_add(&ctx->buttons.geom, pos)) {
+        ctx->buttons.button.size--;
+        return;
+    }
+
+    size_t len = strlen(text);
+    btn->text  = fs_arena_str(&ctx->arena, text, fs_utf8_cut(text, len, MAX_LEN));
+
+    // Label is drawn over the button, never in a layer below it
+    int layer        = ctx->layers.open;
+    ctx->layers.open = NO_SIGNAL;
+    pos[1]          += (pos[3] + fs_run_height(ctx, type, text)) / 2.0f;
+    fs_add_text(ctx, (vec2){ pos[0] + pos[2] / 2.0f, pos[1] }, text, type, ctx->buttons.text_col, ALIGN_CENTER);
+    ctx->layers.open = layer;
+}
+
+static void fs_add_inputbox(fs_Context *ctx, vec4 pos, int flag)
+{
+    // If inputbox is already used on current screen skip and return
+    if (ctx->inputbox.boxes[ctx->screen].box.size < ctx->inputbox.boxes[ctx->screen].count) {
+        ctx->inputbox.boxes[ctx->screen].box.size++;
+        ctx->inputbox.boxes[ctx->screen].geom.size++;
+        return;
+    }
+
+    // Text buffers are allocated once per inputbox index and reused by later screen rebuilds
+    fs_Boxes *boxes = &ctx->inputbox.boxes[ctx->screen];
+    int       index = boxes->box.size;
+    if (index == boxes->text_num) {
+        char **text = realloc(boxes->text, (boxes->text_num + 1) * sizeof(char *));
+        if (text == NULL) {
+            fprintf(stderr, "Error: out of memory, inputbox dropped\n");
+            return;
+        }
+        boxes->text = text;
+        if ((boxes->text[boxes->text_num] = calloc(1, MAX_LEN + 1)) == NULL) {
+            fprintf(stderr, "Error: out of memory, inputbox dropped\n");
+            return;
+        }
+        boxes->text_num++;
+    }
+
+    fs_Box *box = fs_box_vector_push(&boxes->box);
+    if (box == NULL) {
+        return;
+    }
+    if (!fs_geometry_add(&boxes->geom, pos)) {
+        boxes->box.size--;
+        return;
+    }
+
+    memset(box, 0, sizeof(fs_Box));
+    box->text = boxes->text[index];
+    memset(box->text, 0, MAX_LEN + 1); // Reused buffer, text is built without terminators
+    box->flag = flag;
+    fs_invalidate(ctx);
+
+    // Update y coordinate max depth
+    if (pos[1] + pos[3] > ctx->scroll.max) {
+        ctx->scroll.max = pos[1] + pos[3];
+    }
+}
+
+// Quads of rectangles, buttons and inputboxes visible in the window
+static void fs_build_rect_quads(fs_Frame *frame, fs_Rects *rects, vec4 view)
+{
+    fs_Geometry *geom = &rects->geom;
+    for (size_t i = 0; i < geom->size; i += FS_SIMD_WIDTH) {
+        int visible = fs_geometry_overlap_mask(geom, i, view);
+        for (size_t j = i; visible; ++j, visible >>= 1) {
+            fs_Quad *quad;
+            if ((visible & 1) == 0 || (quad = fs_quad_vector_push(&frame->quads)) == NULL) {
+                continue;
+            }
+            fs_Rect *rect = fs_rect_vector_at(&rects->rect, j);
+            fs_quad_set(quad, geom, j, &rect->style);
+        }
+    }
+}
+
+static void fs_build_quads(fs_Context *ctx, fs_Frame *frame)
+{
+    FS_PROFILE_BEGIN("fs_build_quads");
+    fs_quad_vector_clear(&frame->quads);
+
+    // Visible part of the screen: x0,y0,x1,y1
+    float ypos = ctx->my + ctx->scroll.offset / 2.0f;
+    vec4  view = { 0.0f, ctx->scroll.offset / 2.0f, ctx->width, ctx->scroll.offset / 2.0f + ctx->height };
+
+    // Rectangles, those of layers without texture first
+    for (int i = 0; i < frame->layers_num; ++i) {
+        if (frame->layers[i].direct) {
+            fs_build_rect_quads(frame, &ctx->layers.layer[i].rects, view);
+        }
+    }
+    fs_build_rect_quads(frame, &ctx->rects, view);
+
+    // Buttons
+    fs_Style     normal = fs_style(ctx->buttons.normal_col);
+    fs_Style     hover  = fs_style(ctx->buttons.hover_col);
+    fs_Geometry *geom   = &ctx->buttons.geom;
+    for (size_t i = 0; i < geom->size; i += FS_SIMD_WIDTH) {
+        int visible = fs_geometry_overlap_mask(geom, i, view);
+        int hit     = fs_geometry_hit_mask(geom, i, ctx->mx, ypos);
+        for (size_t j = i; visible; ++j, visible >>= 1, hit >>= 1) {
+            fs_Quad *quad;
+            if ((visible & 1) == 0 || (quad = fs_quad_vector_push(&frame->quads)) == NULL) {
+                continue;
+            }
+            fs_quad_set(quad, geom, j, (hit & 1) ? &hover : &normal);
+        }
+    }
+
+    // Inputboxes
+    fs_Style  bg    = fs_style(ctx->inputbox.bg_col);
+    fs_Style  fg    = fs_style(ctx->inputbox.fg_col);
+    fs_Style  sel   = fs_style(ctx->inputbox.sel_col);
+    fs_Boxes *boxes = &ctx->inputbox.boxes[ctx->screen];
+    geom            = &boxes->geom;
+    for (size_t i = 0; i < geom->size; i += FS_SIMD_WIDTH) {
+        int visible = fs_geometry_overlap_mask(geom, i, view);
+        for (size_t j = i; visible; ++j, visible >>= 1) {
+            fs_Quad *quad;
+            if ((visible & 1) == 0 || (quad = fs_quad_vector_push(&frame->quads)) == NULL) {
+                continue;
+            }
+            if (boxes->selected == (int)j && ctx->double_click == GLFW_TRUE) {
+                fs_quad_set(quad, geom, j, &fg);
+            } else if (boxes->selected == (int)j) {
+                fs_quad_set(quad, geom, j, &sel);
+            } else {
+                fs_quad_set(quad, geom, j, &bg);
+            }
+        }
+    }
+    FS_PROFILE_END("fs_build_quads");
+}
+
+// Palette index of text color, a frame has few colors so linear search is fine
+static uint16_t fs_palette_index(fs_Frame *frame, vec4 col)
+{
+    for (int i = frame->palette_num - 1; i >= 0; --i) {
+        if (memcmp(frame->palette[i], col, sizeof(vec4)) == 0) {
+            return (i);
+        }
+    }
+    // Palette full - nearest color
+    if (frame->palette_num == PALETTE_NUM) {
+        int   nearest = 0;
+        float best    = INFINITY;
+        for (int i = 0; i < PALETTE_NUM; ++i) {
+            float dr = frame->palette[i][0] - col[0], dg = frame->palette[i][1] - col[1], db = frame->palette[i][2] - col[2];
+            float d  = dr * dr + dg * dg + db * db;
+            if (d < best) {
+                best    = d;
+                nearest = i;
+            }
+        }
+        return (nearest);
+    }
+    fs_vec4_copy(frame->palette[frame->palette_num], col);
+    return (frame->palette_num++);
+}
+
+// Lines outside a view of height logical pixels are culled, which also keeps instance y in int16 range
+inline static int fs_line_visible(float height, fs_Atlas *atlas, int y)
+{
+    return (y > -2 * atlas->line_px && y < height * atlas->scale + 2 * atlas->line_px);
+}
+
+// Instances a text run produces - must skip exactly what fs_layout_run skips. Also resolves the fallback glyphs
+// of the run, so workers laying it out only read the coverage map.
+static size_t fs_run_glyphs(float height, fs_Atlas *atlas, fs_Text *text, int origin)
+{
+    size_t        n        = 0;
+    int           y        = (int)lroundf(text->pos[1] * atlas->scale) - origin;
+    int           visible  = fs_line_visible(height, atlas, y);
+    unsigned char previous = 32;
+    for (const unsigned char *c = (const unsigned char *)text->text; *c;) {
+        int kerning, advance;
+        if (*c == '\n') {
+            y      += atlas->line_px;
+            visible = fs_line_visible(height, atlas, y);
+            c++;
+            continue;
+        }
+        n += fs_next_glyph(atlas, &c, &previous, &kerning, &advance) != NO_SIGNAL && visible;
+    }
+    return (n);
+}
+
+// Instance of glyph in slot at pen x in atlas units - with phases the fraction selects the variant
+inline static void fs_place_glyph(fs_Atlas *atlas, int pen, int y, int slot, uint16_t color, fs_Instance *inst)
+{
+    if (atlas->phases > 1) {
+        int px    = pen >> 6; // Floor, 26.6
+        int phase = ((pen & 63) * atlas->phases + 32) >> 6;
+        if (phase == atlas->phases) {
+            px++;
+            phase = 0;
+        }
+        inst->x     = px;
+        inst->glyph = slot + phase;
+    } else {
+        inst->x     = pen;
+        inst->glyph = slot;
+    }
+    inst->y     = y;
+    inst->color = color;
+}
+
+// Glyph instances of a string with pen start x in atlas units and baseline y in atlas pixels, returns instances written.
+// Pen x is kept in atlas units, with phases the fraction selects the glyph variant.
+static size_t fs_layout_glyphs(float height, fs_Atlas *atlas, const char *str, int start, int y, uint16_t color, fs_Instance *out)
+{
+    int    x       = start;
+    int    visible = fs_line_visible(height, atlas, y);
+    size_t n       = 0;
+
+    unsigned char previous = 0;
+    for (const unsigned char *c = (const unsigned char *)str; *c;) {
+        if ((*c) == '\n') {
+            x       = start;
+            y      += atlas->line_px;
+            visible = fs_line_visible(height, atlas, y);
+            c++;
+            continue;
+        }
+
+        int kerning, advance;
+        int slot = fs_next_glyph(atlas, &c, &previous, &kerning, &advance);
+        if (slot == NO_SIGNAL) {
+            continue; // No glyph in atlas or fallback fonts
+        }
+        if (visible) {
+            fs_place_glyph(atlas, x + kerning, y, slot, color, &out[n++]);
+        }
+        x += advance + kerning;
+    }
+    return (n);
+}
+
+// Glyph instances of one text run written to out, returns instances written. Positions are atlas pixels relative to origin.
+static size_t fs_layout_run(float height, fs_Atlas *atlas, fs_Text *text, uint16_t color, int origin, fs_Instance *out)
+{
+    int x = (int)lroundf(text->pos[0] * atlas->scale * atlas->unit);
+    int y = (int)lroundf(text->pos[1] * atlas->scale) - origin;
+    return (fs_layout_glyphs(height, atlas, text->text, x, y, color, out));
+}
+
+// Run template with pen positions from a zero start, as fs_layout_glyphs walks the string
+static size_t fs_run_template(fs_Atlas *atlas, const char *str, fs_RunGlyph *out)
+{
+    int    x = 0, y = 0;
+    size_t n = 0;
+
+    unsigned char previous = 0;
+    for (const unsigned char *c = (const unsigned char *)str; *c;) {
+        if ((*c) == '\n') {
+            x  = 0;
+            y += atlas->line_px;
+            c++;
+            continue;
+        }
+
+        int kerning, advance;
+        int slot = fs_next_glyph(atlas, &c, &previous, &kerning, &advance);
+        if (slot == NO_SIGNAL) {
+            continue;
+        }
+        out[n].pen  = x + kerning;
+        out[n].y    = y;
+        out[n].slot = slot;
+        n++;
+        x += advance + kerning;
+    }
+    return (n);
+}
+
+// Place a run template at pen start x and baseline y
+static size_t fs_place_run(float height, fs_Atlas *atlas, const fs_RunGlyph *glyphs, size_t num, int x, int y, uint16_t color, fs_Instance *out)
+{
+    // Culling per instance matches culling per line, all glyphs of a line share y
+    size_t n = 0;
+    for (size_t i = 0; i < num; ++i) {
+        int gy = glyphs[i].y + y;
+        if (fs_line_visible(height, atlas, gy)) {
+            fs_place_glyph(atlas, x + glyphs[i].pen, gy, glyphs[i].slot, color, &out[n++]);
+        }
+    }
+    return (n);
+}
+
+// fs_layout_run through the run cache - the template holds pen positions from a zero start, so placing it at any
+// pen start picks the same phase and pixel as fs_layout_run and output is byte-identical. Main thread only.
+static size_t fs_layout_run_cached(fs_Context *ctx, FontType type, float height, fs_Text *text, uint16_t color, int origin, fs_Instance *out)
+{
+    fs_Atlas *atlas = &ctx->fonts[type];
+    int       x     = (int)lroundf(text->pos[0] * atlas->scale * atlas->unit);
+    int       y     = (int)lroundf(text->pos[1] * atlas->scale) - origin;
+
+    if (ctx->runs.bypass) {
+        ctx->runs.bypassed++;
+#ifdef FS_USE_HARFBUZZ
+        size_t       num;
+        float        width;
+        fs_RunGlyph *shaped = fs_shape_run(&ctx->runs, atlas, text->text, &num, &width);
+        if (shaped != NULL) {
+            size_t n = fs_place_run(height, atlas, shaped, num, x, y, color, out);
+            free(shaped);
+            return (n);
+        }
+#endif
+        return (fs_layout_glyphs(height, atlas, text->text, x, y, color, out));
+    }
+    fs_Run *run = fs_run_lookup(ctx, type, text->text);
+    if (run != NULL && run->glyphs == NULL) {
+        if ((run->glyphs = malloc((strlen(run->text) + 1) * sizeof(fs_RunGlyph))) == NULL) {
+            return (fs_layout_glyphs(height, atlas, text->text, x, y, color, out));
+        }
+        run->glyphs_num = fs_run_template(atlas, run->text, run->glyphs);
+    }
+    if (run == NULL) {
+        return (fs_layout_glyphs(height, atlas, text->text, x, y, color, out));
+    }
+    return (fs_place_run(height, atlas, run->glyphs, run->glyphs_num, x, y, color, out));
+}
+
+#ifdef FS_LAYOUT_THREADS
+static void fs_pool_run_task(fs_Pool *pool, int t)
+{
+    fs_LayoutTask *task  = &pool->tasks[t];
+    fs_Atlas      *atlas = &pool->ctx->fonts[pool->type];
+    for (int i = task->first; i < task->last; ++i) {
+        fs_Text *text = fs_text_vector_at(&pool->ctx->texts[pool->type].text, i);
+        fs_layout_run(pool->ctx->height, atlas, text, pool->colors[i], pool->frame->origin[pool->type], fs_instance_vector_at(pool->glyphs, pool->offsets[i]));
+    }
+}
+
+// Drain own queue, then steal remaining tasks from the other queues
+static void fs_pool_work(fs_Pool *pool, int id)
+{
+    for (int k = 0; k < FS_LAYOUT_THREADS + 1; ++k) {
+        fs_PoolQueue *queue = &pool->queues[(id + k) % (FS_LAYOUT_THREADS + 1)];
+        int           t;
+        while ((t = atomic_fetch_add(&queue->next, 1)) < queue->end) {
+            fs_pool_run_task(pool, t);
+        }
+    }
+}
+
+static int fs_pool_worker(void *arg)
+{
+    fs_Pool      *pool = ((fs_PoolWorker *)arg)->pool;
+    int           id   = ((fs_PoolWorker *)arg)->id;
+    unsigned long seen = 0;
+
+    while (1) {
+        mtx_lock(&pool->lock);
+        while (!pool->quit && pool->job == seen) {
+            cnd_wait(&pool->wake, &pool->lock);
+        }
+        seen     = pool->job;
+        int quit = pool->quit;
+        mtx_unlock(&pool->lock);
+
+        if (quit) {
+            break;
+        }
+        fs_pool_work(pool, id);
+
+        mtx_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            cnd_signal(&pool->done);
+        }
+        mtx_unlock(&pool->lock);
+    }
+    return (0);
+}
+
+static void fs_pool_start(fs_Pool *pool)
+{
+    mtx_init(&pool->lock, mtx_plain);
+    cnd_init(&pool->wake);
+    cnd_init(&pool->done);
+    for (int i = 0; i < FS_LAYOUT_THREADS; ++i) {
+        pool->workers[i] = (fs_PoolWorker){ pool, i + 1 };
+        if (thrd_create(&pool->threads[i], fs_pool_worker, &pool->workers[i]) != thrd_success) {
+            assert(0 && "Error: failed to start layout thread");
+        }
+    }
+}
 
-        case GLFW_KEY_TAB:
-            if (mods == GLFW_MOD_SHIFT) {
-                if (ctx->inputbox.boxes[ctx->screen].selected > 0) {
-                    ctx->inputbox.boxes[ctx->screen].selected--;
-                } else {
-                    ctx->inputbox.boxes[ctx->screen].selected = ctx->inputbox.boxes[ctx->screen].box->size - 1;
-                }
-            } else {
-                if (ctx->inputbox.boxes[ctx->screen].selected < ctx->inputbox.boxes[ctx->screen].box->size - 1) {
-                    ctx->inputbox.boxes[ctx->screen].selected++;
-                } else {
-                    ctx->inputbox.boxes[ctx->screen].selected = 0;
-                }
-            }
-            ctx->double_click = GLFW_FALSE;
-        break;
+static void fs_pool_stop(fs_Pool *pool)
+{
+    mtx_lock(&pool->lock);
+    pool->quit = 1;
+    cnd_broadcast(&pool->wake);
+    mtx_unlock(&pool->lock);
+    for (int i = 0; i < FS_LAYOUT_THREADS; ++i) {
+        thrd_join(pool->threads[i], NULL);
+    }
+    mtx_destroy(&pool->lock);
+    cnd_destroy(&pool->wake);
+    cnd_destroy(&pool->done);
+    free(pool->tasks);
+    free(pool->offsets);
+    free(pool->colors);
+}
 
-        case GLFW_KEY_ENTER:
-            ctx->inputbox.boxes[ctx->screen].commited = GLFW_TRUE;
-        break;
+// Prefix offsets of runs in instance space, then fill instance slots in parallel.
+// Same fs_layout_run as serial path, so output is byte-identical.
+static int fs_layout_text_parallel(fs_Context *ctx, fs_Frame *frame, FontType type, fs_InstanceVector *glyphs)
+{
+    fs_Pool  *pool  = &ctx->pool;
+    fs_Texts *texts = &ctx->texts[type];
+    fs_Atlas *atlas = &ctx->fonts[type];
+
+    if (pool->offsets_cap < texts->text.size) {
+        size_t   *offsets = realloc(pool->offsets, texts->text.size * sizeof(size_t));
+        uint16_t *colors  = realloc(pool->colors, texts->text.size * sizeof(uint16_t));
+        pool->offsets     = offsets ? offsets : pool->offsets;
+        pool->colors      = colors ? colors : pool->colors;
+        if (offsets == NULL || colors == NULL) {
+            return (0);
+        }
+        pool->offsets_cap = texts->text.size;
     }
 
-    if ((GLFW_MOD_CONTROL & mods) == 0 || ctx->inputbox.boxes[ctx->screen].selected == NO_SIGNAL) {
-        return;
+    // Palette is filled here, workers only read it
+    size_t total = 0;
+    for (int i = 0; i < texts->text.size; ++i) {
+        fs_Text *text    = fs_text_vector_at(&texts->text, i);
+        pool->offsets[i] = total;
+        pool->colors[i]  = fs_palette_index(frame, text->col);
+        total           += fs_run_glyphs(ctx->height, atlas, text, frame->origin[type]);
+    }
+    if (total < FS_LAYOUT_PARALLEL || !fs_instance_vector_reserve(glyphs, total)) {
+        return (0);
     }
 
-    switch (key) {
-        case GLFW_KEY_V:
-            // Basic clipboad checks
-            const char *cb = glfwGetClipboardString(ctx->window);
-            if (cb == NULL || *cb == '\r' || *cb == '\n') {
-                return;
+    // Tasks of consecutive runs with about LAYOUT_CHUNK glyphs each
+    pool->tasks_num = 0;
+    for (int i = 0; i < texts->text.size;) {
+        if (pool->tasks_num == pool->tasks_cap) {
+            int            cap   = pool->tasks_cap ? pool->tasks_cap * 2 : 64;
+            fs_LayoutTask *tasks = realloc(pool->tasks, cap * sizeof(fs_LayoutTask));
+            if (tasks == NULL) {
+                return (0);
             }
+            pool->tasks     = tasks;
+            pool->tasks_cap = cap;
+        }
+        fs_LayoutTask *task = &pool->tasks[pool->tasks_num++];
+        task->first         = i;
+        size_t start        = pool->offsets[i];
+        while (++i < texts->text.size && pool->offsets[i] - start < LAYOUT_CHUNK) {
+        }
+        task->last = i;
+    }
 
-            // Remove new lines and subsequent characters
-            for (unsigned char *p = (unsigned char *)cb; *p; ++p) {
-                if (*p == '\r' || *p == '\n') {
-                    *p = '\0';
-                    break;
-                }
-            }
+    // Contiguous task range per queue, calling thread is queue 0
+    int queues = FS_LAYOUT_THREADS + 1;
+    for (int q = 0; q < queues; ++q) {
+        atomic_store(&pool->queues[q].next, pool->tasks_num * q / queues);
+        pool->queues[q].end = pool->tasks_num * (q + 1) / queues;
+    }
 
-            // Text in clipboard valid for numeric inputbox?
-            if (box->flag == NUM) {
-                char   *pEnd;
-                double value = strtod(cb, &pEnd);
-                if (pEnd == cb || *pEnd != '\0') {
-                    return;
-                }
-            }
+    mtx_lock(&pool->lock);
+    pool->ctx    = ctx;
+    pool->frame  = frame;
+    pool->type   = type;
+    pool->glyphs = glyphs;
+    pool->busy   = FS_LAYOUT_THREADS;
+    pool->job++;
+    cnd_broadcast(&pool->wake);
+    mtx_unlock(&pool->lock);
+
+    fs_pool_work(pool, 0);
+
+    mtx_lock(&pool->lock);
+    while (pool->busy > 0) {
+        cnd_wait(&pool->done, &pool->lock);
+    }
+    mtx_unlock(&pool->lock);
 
-            // Calculate number of characters to paste
-            char buf[MAX_LEN + 1] = { 0 };
-            int  copy_len         = 0;
+    glyphs->size = total;
+    return (1);
+}
+#endif // FS_LAYOUT_THREADS
 
-            for (unsigned char *p = (unsigned char *)cb; *p; ++p) {
-                buf[copy_len] = *p;
-                float width = fs_text_width(&ctx->fonts[BOX], buf) + PADDING;
-                if (width > box->pos[2]) {
-                    buf[copy_len] = '\0';
-                    break;
-                }
-                ++copy_len;
-            }
-            ctx->double_click = GLFW_FALSE;
-            fs_set_inputbox_content(ctx, ctx->inputbox.boxes[ctx->screen].selected, buf);
-        break;
+static void fs_layout_texts(fs_Context *ctx, fs_Frame *frame, FontType type, fs_Texts *texts, fs_InstanceVector *glyphs)
+{
+    for (int i = 0; i < texts->text.size; ++i) {
+        fs_Text *text = fs_text_vector_at(&texts->text, i);
 
-        case GLFW_KEY_C:
-            fs_Box *box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, ctx->inputbox.boxes[ctx->screen].selected);
-            glfwSetClipboardString(ctx->window, box->text);
-        break;
+        if (!fs_instance_vector_reserve(glyphs, glyphs->size + fs_str_len(text->text))) {
+            fprintf(stderr, "Error: out of memory, text dropped\n");
+            continue;
+        }
+        glyphs->size += fs_layout_run_cached(ctx, type, ctx->height, text, fs_palette_index(frame, text->col), frame->origin[type],
+                                             fs_instance_vector_at(glyphs, glyphs->size));
     }
 }
 
-static void fs_button_callback(GLFWwindow *window, int btn_m, int action, int mods)
+// Glyph instances of all texts of one font
+static void fs_layout_text(fs_Context *ctx, fs_Frame *frame, FontType type)
 {
-    if (btn_m != GLFW_MOUSE_BUTTON_LEFT) {
+    FS_PROFILE_BEGIN("fs_layout_text");
+    fs_InstanceVector *glyphs = &frame->glyphs[type];
+    fs_instance_vector_clear(glyphs);
+
+    // Texts of layers without texture first, below the others
+    for (int i = 0; i < frame->layers_num; ++i) {
+        if (frame->layers[i].direct) {
+            fs_layout_texts(ctx, frame, type, &ctx->layers.layer[i].texts[type], glyphs);
+        }
+    }
+
+#if defined(FS_LAYOUT_THREADS) && !defined(FS_USE_HARFBUZZ) // Shaping and glyphs on demand are main thread only
+    if (glyphs->size == 0 && fs_layout_text_parallel(ctx, frame, type, glyphs)) {
+        FS_PROFILE_END("fs_layout_text");
         return;
     }
-    fs_Context *ctx = (fs_Context *)glfwGetWindowUserPointer(window);
-    if (action == GLFW_PRESS) {
-        // Any button clicked?
-        float ypos = ctx->my + ctx->scroll.offset / 2.0f;
-        for (int i = 0; i < ctx->buttons.button->size; ++i) {
-            fs_Button *btn = (fs_Button *)fs_vector_get(ctx->buttons.button, i);
-            if (ctx->mx > btn->pos[0] && ctx->mx < btn->pos[0] + btn->pos[2] && ypos > btn->pos[1] && ypos < btn->pos[1] + btn->pos[3]) {
-                ctx->buttons.clicked = i;
+#endif
+
+    fs_layout_texts(ctx, frame, type, &ctx->texts[type], glyphs);
+    FS_PROFILE_END("fs_layout_text");
+}
+
+// Layer bounds from its rects and text blocks, snapped outwards to the framebuffer pixel grid
+static void fs_layer_bounds(fs_Context *ctx, fs_Layer *layer)
+{
+    float        x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    fs_Geometry *geom = &layer->rects.geom;
+    for (size_t i = 0; i < geom->size; ++i) {
+        x0 = fminf(x0, fminf(geom->x[i], geom->x[i] + geom->w[i]));
+        x1 = fmaxf(x1, fmaxf(geom->x[i], geom->x[i] + geom->w[i]));
+        y0 = fminf(y0, fminf(geom->y[i], geom->y[i] + geom->h[i]));
+        y1 = fmaxf(y1, fmaxf(geom->y[i], geom->y[i] + geom->h[i]));
+    }
+    for (int type = 0; type < FONTS_NUM; ++type) {
+        fs_Atlas *atlas = &ctx->fonts[type];
+        for (int i = 0; i < layer->texts[type].text.size; ++i) {
+            fs_Text *text  = fs_text_vector_at(&layer->texts[type].text, i);
+            float    width = 0;
+            int      rows  = 0;
+            fs_block_width(atlas, text->text, &width, &rows);
+            // Position is the first baseline, glyphs may overhang their advance
+            x0 = fminf(x0, text->pos[0] - PADDING);
+            x1 = fmaxf(x1, text->pos[0] + width + PADDING);
+            y0 = fminf(y0, text->pos[1] - atlas->line_height);
+            y1 = fmaxf(y1, text->pos[1] + rows * atlas->line_height);
+        }
+    }
+    if (x0 > x1) {
+        memset(layer->bounds, 0, sizeof(vec4)); // Empty layer
+        return;
+    }
+    float scale      = ctx->scale;
+    layer->bounds[0] = floorf(x0 * scale) / scale;
+    layer->bounds[1] = floorf(y0 * scale) / scale;
+    layer->bounds[2] = ceilf(x1 * scale) / scale - layer->bounds[0];
+    layer->bounds[3] = ceilf(y1 * scale) / scale - layer->bounds[1];
+}
+
+// Texts laid out this frame at most - if every one of them can't stay cached, each lookup would evict a run needed
+// later in the same frame
+static void fs_run_cache_plan(fs_Context *ctx)
+{
+    int live = 0;
+    for (int type = 0; type < FONTS_NUM; ++type) {
+        live += ctx->texts[type].text.size;
+        for (int i = 0; i < ctx->layers.num; ++i) {
+            live += ctx->layers.layer[i].texts[type].text.size;
+        }
+    }
+    ctx->runs.bypass = live > RUN_CACHE_SIZE;
+}
+
+// Layer content is recorded until the GL side has rendered its current version
+static void fs_build_layers(fs_Context *ctx, fs_Frame *frame)
+{
+    FS_PROFILE_BEGIN("fs_build_layers");
+    frame->layers_num = ctx->layers.num;
+    frame->layer_tex  = ctx->screens[ctx->screen]->layer_tex;
+    for (int i = 0; i < ctx->layers.num; ++i) {
+        fs_Layer      *layer = &ctx->layers.layer[i];
+        fs_FrameLayer *out   = &frame->layers[i];
+        out->redraw          = layer->version != frame->layer_tex[i].version;
+        if (out->redraw) {
+            fs_layer_bounds(ctx, layer);
+        }
+        fs_vec4_copy(out->bounds, layer->bounds);
+        out->width   = lroundf(layer->bounds[2] * ctx->scale);
+        out->height  = lroundf(layer->bounds[3] * ctx->scale);
+        out->version = layer->version;
+
+        // Larger than a texture can be, or its framebuffer failed - drawn every frame with the other elements
+        out->direct = out->width > ctx->max_texture || out->height > ctx->max_texture || frame->layer_tex[i].failed == layer->version;
+        if (out->direct) {
+            out->redraw = 0;
+        }
+        if (!out->redraw) {
+            continue;
+        }
+
+        fs_quad_vector_clear(&out->quads);
+        fs_Geometry *geom = &layer->rects.geom;
+        for (size_t j = 0; j < geom->size; ++j) {
+            fs_Quad *quad = fs_quad_vector_push(&out->quads);
+            if (quad) {
+                fs_quad_set(quad, geom, j, &fs_rect_vector_at(&layer->rects.rect, j)->style);
             }
         }
 
-        // Any inputbox clicked or double-clicked?
-        for (int i = 0; i < ctx->inputbox.boxes[ctx->screen].box->size; ++i) {
-            fs_Box *box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, i);
-            if (ctx->mx > box->pos[0] && ctx->mx < box->pos[0] + box->pos[2] && ypos > box->pos[1] && ypos < box->pos[1] + box->pos[3]) {
-                ctx->inputbox.boxes[ctx->screen].selected = i;
-                float dt = glfwGetTime() - ctx->last_click;
-                if (dt > CLICK_LO && dt < CLICK_HI) {
-                    ctx->double_click = GLFW_TRUE;
-                } else {
-                    ctx->double_click = GLFW_FALSE;
+        for (int type = 0; type < FONTS_NUM; ++type) {
+            fs_Atlas          *atlas  = &ctx->fonts[type];
+            fs_InstanceVector *glyphs = &out->glyphs[type];
+            fs_instance_vector_clear(glyphs);
+            out->origin[type] = (int)floorf(layer->bounds[1] * atlas->scale);
+            for (int j = 0; j < layer->texts[type].text.size; ++j) {
+                fs_Text *text = fs_text_vector_at(&layer->texts[type].text, j);
+                if (!fs_instance_vector_reserve(glyphs, glyphs->size + fs_str_len(text->text))) {
+                    fprintf(stderr, "Error: out of memory, text dropped\n");
+                    continue;
                 }
-                ctx->last_click = glfwGetTime();
-                return;
+                glyphs->size += fs_layout_run_cached(ctx, type, layer->bounds[3], text, fs_palette_index(frame, text->col), out->origin[type],
+                                                     fs_instance_vector_at(glyphs, glyphs->size));
             }
         }
     }
+    FS_PROFILE_END("fs_build_layers");
 }
 
-static void fs_scroll_callback(GLFWwindow *window, double offsetX, double offsetY)
+// Record everything needed to draw current screen - no GL calls
+static void fs_build_frame(fs_Context *ctx, fs_Frame *frame)
 {
-    fs_Context *ctx = (fs_Context *)glfwGetWindowUserPointer(window);
+    FS_PROFILE_BEGIN("fs_build_frame");
+    frame->width         = ctx->fb_width;
+    frame->height        = ctx->fb_height;
+    frame->res[0]        = ctx->fb_width / ctx->scale;
+    frame->res[1]        = ctx->fb_height / ctx->scale;
+    frame->scale         = ctx->scale;
+    frame->swap_interval = ctx->sched.swap_interval;
+    frame->capture       = ctx->capture;
+    ctx->capture         = 0;
+    frame->view_top      = roundf(ctx->scroll.offset / 2.0f * ctx->scale) / ctx->scale; // Framebuffer pixel grid
+    frame->palette_num   = 0;
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        // Glyphs snap to atlas pixels, the rest of the scroll is in the shader
+        frame->origin[i]    = (int)floorf(frame->view_top * ctx->fonts[i].scale);
+        frame->atlas_gen[i] = ctx->fonts[i].gen;
+    }
+    fs_mat4_set_identity(frame->transform);
+    fs_mat4_translate(frame->transform, (vec3){ 0.0f, 2.0f * frame->view_top / frame->res[1], 0.0f });
+
+    // Update inputbox text and configure inputbox text position
+    fs_Geometry *geom = &ctx->inputbox.boxes[ctx->screen].geom;
+    for (int i = 0; i < ctx->inputbox.boxes[ctx->screen].box.size; ++i) {
+        fs_Box *box = fs_box_vector_at(&ctx->inputbox.boxes[ctx->screen].box, i);
+        // Height of text should be fixed to avoid the text jumping up and down
+        float ypos = geom->y[i] + (geom->h[i] + ctx->fonts[BOX].glyphs['0' - 32].bitmap_height / ctx->fonts[BOX].scale) / 2.0f;
+
+        if (ctx->inputbox.boxes[ctx->screen].selected == i && ctx->double_click == GLFW_TRUE) {
+            fs_add_text(ctx, (vec2){ geom->x[i] + PADDING, ypos }, box->text, BOX, ctx->inputbox.bg_col, ALIGN_LEFT);
+        } else {
+            fs_add_text(ctx, (vec2){ geom->x[i] + PADDING, ypos }, box->text, BOX, ctx->inputbox.fg_col, ALIGN_LEFT);
+        }
+    }
+
+    fs_run_cache_plan(ctx);
+    fs_build_layers(ctx, frame);
+    fs_build_quads(ctx, frame);
+    for (int i = 0; i < FONTS_NUM - 1; ++i) {
+        fs_layout_text(ctx, frame, i);
+    }
+    fs_text_vector_clear(&ctx->texts[BOX].text);
+
+    // Hover area callback adds its text
+    frame->hover = fs_check_area(ctx);
+    if (frame->hover) {
+        fs_Area *area     = fs_area_vector_at(&ctx->areas.area, ctx->areas.active);
+        fs_vec4_copy(frame->hover_quad.rect, area->text_pos);
+        frame->hover_quad.style = fs_style(ctx->areas.col);
+        fs_layout_text(ctx, frame, HOVER);
+        fs_text_vector_clear(&ctx->texts[HOVER].text);
+    }
+    fs_arena_reset(&ctx->frame_arena);
 
-    ctx->scroll.offset   -= offsetY * ACC_Y;
-    ctx->scroll.direction = (offsetY > 0) - (offsetY < 0);
-    ctx->scroll.speed     = ACC_Y;
-    ctx->scroll.factor    = SLOWDOWN;
+    // Glyphs rasterized on demand so far, measurement outside the frame may add some too
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        frame->glyph_patches[i] = ctx->fonts[i].log ? ctx->fonts[i].log->num : 0;
+    }
+    FS_PROFILE_END("fs_build_frame");
 }
 
-static void fs_resize_callback(GLFWwindow *window, int width, int height)
+// GL side: largest upload to a streamed instance buffer, for fs_memory_report
+inline static void fs_stream_bytes(fs_Shader *shader, size_t bytes)
 {
-    fs_Context *ctx = (fs_Context *)glfwGetWindowUserPointer(window);
+    if (bytes > shader->stream_bytes) {
+        shader->stream_bytes = bytes;
+    }
+}
 
-    glViewport(0, 0, width, height);
-    ctx->width  = width;
-    ctx->height = height;
+// Draw quads as instances in one call
+static void fs_render_quads(fs_Context *ctx, fs_Quad *quads, size_t n)
+{
+    fs_gl_program(ctx, ctx->quad_shader.program);
+    fs_gl_vao(ctx, ctx->quad_shader.vao);
+
+    fs_gl_array_buffer(ctx, ctx->quad_shader.vbo_instance_data);
+    glBufferData(GL_ARRAY_BUFFER, n * sizeof(fs_Quad), quads, GL_STREAM_DRAW);
+    fs_stream_bytes(&ctx->quad_shader, n * sizeof(fs_Quad));
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n);
 }
 
-static void fs_add_area(fs_Context *ctx, vec4 pos, void *callback_fn)
+void fs_render_area_background(fs_Context *ctx, fs_Frame *frame)
 {
-    fs_Area area;
+    fs_render_quads(ctx, &frame->hover_quad, 1);
+}
 
-    fs_vec4_copy(area.pos, pos);
-    area.func = callback_fn;
-    fs_vector_add(ctx->areas.area, &area);
+static void fs_render_rects(fs_Context *ctx, fs_Frame *frame)
+{
+    FS_PROFILE_BEGIN("fs_render_rects");
+    fs_render_quads(ctx, fs_quad_vector_at(&frame->quads, 0), frame->quads.size);
+    FS_PROFILE_END("fs_render_rects");
 }
 
-static void fs_add_rect(fs_Context *ctx, vec4 pos, vec4 col)
+// Glyph instances of one font, positions relative to origin
+static void fs_render_glyphs(fs_Context *ctx, fs_InstanceVector *glyphs, FontType type, int origin, float scale)
 {
-    fs_Rect rect;
+    fs_AtlasTex *tex = &ctx->atlas_tex[type];
+
+    fs_gl_program(ctx, ctx->text_shader.program);
+    fs_gl_vao(ctx, ctx->text_shader.vao);
+
+    fs_Shader *shader    = &ctx->text_shader;
+    vec2       res_atlas = { tex->tex_width, tex->tex_height };
+    float      top       = origin;
+    GLint      base      = tex->metrics_base;
+    GLint      aligned   = tex->scale == scale;
+    fs_gl_uniform(ctx, shader, UNIFORM_RES_ATLAS, res_atlas, 2, 0);
+    fs_gl_uniform(ctx, shader, UNIFORM_GAMMA, &tex->gamma, 1, 0);
+    fs_gl_uniform(ctx, shader, UNIFORM_METRICS_BASE, &base, 1, 1);
+    fs_gl_uniform(ctx, shader, UNIFORM_SCALE, &tex->scale, 1, 0);
+    fs_gl_uniform(ctx, shader, UNIFORM_ORIGIN, &top, 1, 0);
+    fs_gl_uniform(ctx, shader, UNIFORM_ALIGNED, &aligned, 1, 1);
+
+    // Instance data: position, glyph index and color index
+    fs_gl_array_buffer(ctx, ctx->text_shader.vbo_instance_data);
+    glBufferData(GL_ARRAY_BUFFER, glyphs->size * sizeof(fs_Instance), fs_instance_vector_at(glyphs, 0), GL_STREAM_DRAW);
+    fs_stream_bytes(&ctx->text_shader, glyphs->size * sizeof(fs_Instance));
+
+    // Render glyphs - metrics buffer stays bound on unit 1
+    fs_gl_texture(ctx, 0, GL_TEXTURE_2D, tex->tex_id);
+#ifdef FS_TEXT_DUAL_SOURCE
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC1_COLOR); // Coverage per channel
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, glyphs->size);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+#else
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, glyphs->size);
+#endif
+}
 
-    fs_vec4_copy(rect.pos, pos);
-    fs_vec4_copy(rect.col, col);
-    fs_vector_add(ctx->rects.rect, &rect);
+void fs_render_text(fs_Context *ctx, fs_Frame *frame, FontType type)
+{
+    FS_PROFILE_BEGIN("fs_render_text");
+    fs_render_glyphs(ctx, &frame->glyphs[type], type, frame->origin[type], frame->scale);
+    FS_PROFILE_END("fs_render_text");
 }
 
-static void fs_add_text(fs_Context *ctx, vec2 pos, char *text, FontType type, vec4 fg_col, Align alignment)
+// Window or layer size in logical pixels and its transformation for all programs, one buffer update
+static void fs_set_view(fs_Context *ctx, vec2 res, mat4 transform, float scale)
 {
-    fs_Atlas *atlas = &ctx->fonts[type];
-    fs_Text  txt;
+    fs_View view = { .res = { res[0], res[1] }, .scale = scale };
+    memcpy(view.transform, transform, sizeof(mat4));
+    glBindBuffer(GL_UNIFORM_BUFFER, ctx->ubo_view);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(fs_View), &view);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    ctx->gl.changes++;
+}
 
-    switch (alignment) {
-        case ALIGN_CENTER:
-            pos[0] -= fs_text_width(atlas, text) / 2.0f;
-        break;
+// Render layer content into its texture when the frame has a newer version than the texture
+static void fs_render_layer(fs_Context *ctx, fs_Frame *frame, int i)
+{
+    fs_FrameLayer *layer = &frame->layers[i];
+    fs_LayerTex   *tex   = &frame->layer_tex[i];
+    if (!layer->redraw || layer->version == tex->version) {
+        return;
+    }
+    FS_PROFILE_BEGIN("fs_render_layer");
+
+    // Texture follows layer size
+    if (tex->width != layer->width || tex->height != layer->height) {
+        glDeleteFramebuffers(1, &tex->fbo);
+        fs_gl_delete_texture(ctx, tex->tex_id);
+        tex->fbo    = 0;
+        tex->tex_id = 0;
+        tex->width  = 0;
+        tex->height = 0;
+        if (layer->width > 0 && layer->height > 0) {
+            glGenTextures(1, &tex->tex_id);
+            fs_gl_texture(ctx, 0, GL_TEXTURE_2D, tex->tex_id);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, layer->width, layer->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+            glGenFramebuffers(1, &tex->fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, tex->fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex->tex_id, 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+                tex->width  = layer->width;
+                tex->height = layer->height;
+            } else {
+                fprintf(stderr, "Error: layer %d framebuffer %dx%d incomplete\n", i, layer->width, layer->height);
+                tex->failed = layer->version; // Main thread draws it without texture from now on
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+    }
 
-        case ALIGN_RIGHT:
-            pos[0] -= fs_text_width(atlas, text);
-        break;
+    // Same pipeline as the window with the layer as view
+    if (tex->width > 0) {
+        mat4 transform;
+        fs_mat4_set_identity(transform);
+        fs_mat4_translate(transform, (vec3){ -2.0f * layer->bounds[0] / layer->bounds[2], 2.0f * layer->bounds[1] / layer->bounds[3], 0.0f });
+        fs_set_view(ctx, (vec2){ tex->width / frame->scale, tex->height / frame->scale }, transform, frame->scale);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, tex->fbo);
+        glViewport(0, 0, tex->width, tex->height);
+        glClear(GL_COLOR_BUFFER_BIT);
+        fs_render_quads(ctx, fs_quad_vector_at(&layer->quads, 0), layer->quads.size);
+        for (int type = 0; type < FONTS_NUM; ++type) {
+            fs_render_glyphs(ctx, &layer->glyphs[type], type, layer->origin[type], frame->scale);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    tex->version = layer->version; // Failed layers are not retried until invalidated, the frame lists draw them
+    FS_PROFILE_END("fs_render_layer");
+}
 
-        default:
-        break;
+// Layer textures as one quad each, in layer order
+static void fs_render_layers(fs_Context *ctx, fs_Frame *frame)
+{
+    for (int i = 0; i < frame->layers_num; ++i) {
+        fs_LayerTex *tex = &frame->layer_tex[i];
+        if (tex->width == 0 || tex->version != frame->layers[i].version) {
+            continue;
+        }
+        fs_gl_program(ctx, ctx->layer_shader.program);
+        fs_gl_vao(ctx, ctx->layer_shader.vao);
+        fs_gl_texture(ctx, 0, GL_TEXTURE_2D, tex->tex_id);
+        fs_gl_uniform(ctx, &ctx->layer_shader, UNIFORM_RECT, frame->layers[i].bounds, 4, 0);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+}
+
+// Frame content into the bound framebuffer
+static void fs_draw_frame(fs_Context *ctx, fs_Frame *frame)
+{
+    glViewport(0, 0, frame->width, frame->height);
+    fs_set_view(ctx, frame->res, frame->transform, frame->scale);
+
+    // Clear buffer
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Render static layers, then rectangles
+    fs_render_layers(ctx, frame);
+    fs_render_rects(ctx, frame);
+
+    // Render texts
+    for (int i = 0; i < FONTS_NUM - 1; ++i) {
+        fs_render_text(ctx, frame, i);
     }
 
-    strncpy(txt.text, text, MAX_LEN);
-    fs_vec4_copy(txt.col, fg_col);
-    fs_vec2_copy(txt.pos, pos);
-    fs_vector_add(ctx->texts[type].text, &txt);
+    // Render hover area on top
+    if (frame->hover) {
+        fs_render_area_background(ctx, frame);
+        fs_render_text(ctx, frame, HOVER);
+    }
 }
 
-static void fs_add_area_text(fs_Context *ctx, char *text, vec4 fg_col)
+// Render frame into an offscreen renderbuffer and hash its pixels - window buffers of a hidden window are undefined
+static void fs_capture_frame(fs_Context *ctx, fs_Frame *frame)
 {
-    text[strlen(text)] = '\0';
-    float width = 0;
-    int   rows  = 3; // Min 1 row and  1 + 1 extra blank row at top and bottom
+    size_t         size   = (size_t)frame->width * frame->height * 3;
+    unsigned char *pixels = malloc(size);
+    uint64_t       hash   = 0;
+    GLuint         fbo, rbo;
+    glGenRenderbuffers(1, &rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, frame->width, frame->height);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+
+    if (pixels == NULL || glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Error: frame capture %dx%d failed\n", frame->width, frame->height);
+    } else {
+        fs_draw_frame(ctx, frame);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, frame->width, frame->height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        hash = 0xCBF29CE484222325ull; // FNV-1a
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ pixels[i]) * 0x100000001B3ull;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &rbo);
+    free(pixels);
+
+    ctx->capture_hash = hash;
+#ifdef FS_RENDER_THREAD
+    if (ctx->render.running) {
+        mtx_lock(&ctx->render.lock);
+        ctx->captures++;
+        cnd_broadcast(&ctx->render.done);
+        mtx_unlock(&ctx->render.lock);
+        return;
+    }
+#endif
+    ctx->captures++;
+}
 
-    fs_Atlas *atlas = &ctx->fonts[HOVER];
-    fs_block_width(atlas, text, &width, &rows);
+// Draw recorded frame - GL thread only
+static void fs_submit_frame(fs_Context *ctx, fs_Frame *frame)
+{
+    FS_PROFILE_BEGIN("fs_submit_frame");
+    ctx->gl.changes = 0;
+    ctx->gl.skipped = 0;
+    if (frame->swap_interval != ctx->swap_applied) {
+        glfwSwapInterval(frame->swap_interval);
+        ctx->swap_applied = frame->swap_interval;
+    }
+    fs_upload_pending(ctx, frame);
 
-    fs_Area *area  = (fs_Area *)fs_vector_get(ctx->areas.area, ctx->areas.active);
-    float   ypos   = ctx->my + ctx->scroll.offset / 2.0f;
-    vec4    bg_pos = { ctx->mx, ypos, width + ctx->fonts[HOVER].line_height * 2.0f, rows * ctx->fonts[HOVER].line_height };
-    fs_vec4_copy(area->text_pos, bg_pos);
-    fs_add_text(ctx, (vec2){ ctx->mx + ctx->fonts[HOVER].line_height, ypos + ctx->fonts[HOVER].line_height * 2.0f }, text, HOVER, fg_col, ALIGN_LEFT);
+    // Text colors of this frame
+    glBindBuffer(GL_UNIFORM_BUFFER, ctx->text_shader.ubo_palette);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, frame->palette_num * sizeof(vec4), frame->palette);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // Layers with new content
+    for (int i = 0; i < frame->layers_num; ++i) {
+        fs_render_layer(ctx, frame, i);
+    }
+    if (frame->capture) {
+        fs_capture_frame(ctx, frame);
+    }
+    fs_draw_frame(ctx, frame);
+    ctx->gl.frame_changes = ctx->gl.changes;
+    ctx->gl.frame_skipped = ctx->gl.skipped;
+    FS_PROFILE_END("fs_submit_frame");
 }
 
-static int fs_check_area(fs_Context *ctx)
+// State changes of the last submitted frame - binds made and redundant binds skipped by the tracked state
+static void fs_gl_state_report(fs_Context *ctx)
 {
-    float ypos = ctx->my + ctx->scroll.offset / 2.0f;
+    printf("GL state: %lu changes, %lu redundant binds and uniform updates skipped in last frame\n", (unsigned long)ctx->gl.frame_changes,
+           (unsigned long)ctx->gl.frame_skipped);
+}
+
+static void fs_read_front(fs_Context *ctx, unsigned char *buffer)
+{
+    glReadBuffer(GL_FRONT);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, ctx->fb_width, ctx->fb_height, GL_RGB, GL_UNSIGNED_BYTE, buffer);
+}
+
+#ifdef FS_RENDER_THREAD
+// GL thread: render newest published frame, older unconsumed frames are skipped
+static int fs_render_thread(void *arg)
+{
+    fs_Context      *ctx = (fs_Context *)arg;
+    fs_RenderThread *rt  = &ctx->render;
+
+#ifdef FS_PROFILE
+    fs_profile_tid = 1;
+#endif
+    glfwMakeContextCurrent(ctx->window);
+
+    while (1) {
+        mtx_lock(&rt->lock);
+        while (!rt->quit && !(atomic_load(&rt->ready) & FRAME_FRESH) && rt->readback == NULL) {
+            cnd_wait(&rt->wake, &rt->lock);
+        }
+        int            quit     = rt->quit;
+        unsigned char *readback = rt->readback;
+        mtx_unlock(&rt->lock);
+
+        if (quit) {
+            break;
+        }
 
-    for (int i = 0; i < ctx->areas.area->size; ++i) {
-        fs_Area *hover = (fs_Area *)fs_vector_get(ctx->areas.area, i);
-        if ((ctx->mx > hover->pos[0] && ctx->mx < hover->pos[0] + hover->pos[2] && ypos > hover->pos[1] && ypos < hover->pos[1] + hover->pos[3])) {
-            ctx->areas.active = i;
-            hover->func(ctx);
-            return (1);
+        if (atomic_load(&rt->ready) & FRAME_FRESH) {
+            rt->read = atomic_exchange(&rt->ready, rt->read) & ~FRAME_FRESH;
+            fs_submit_frame(ctx, &ctx->frames[rt->read]);
+            glfwSwapBuffers(ctx->window);
+            atomic_fetch_add(&rt->presented, 1);
+        }
+
+        if (readback) {
+            fs_read_front(ctx, readback);
+            mtx_lock(&rt->lock);
+            rt->readback = NULL;
+            cnd_broadcast(&rt->done);
+            mtx_unlock(&rt->lock);
         }
     }
 
+    glfwMakeContextCurrent(NULL);
     return (0);
 }
 
-static void fs_add_button(fs_Context *ctx, vec4 pos, char *text, FontType type)
+static void fs_render_thread_start(fs_Context *ctx)
+{
+    fs_RenderThread *rt = &ctx->render;
+
+    rt->write = 0;
+    rt->read  = 1;
+    atomic_store(&rt->ready, 2);
+    mtx_init(&rt->lock, mtx_plain);
+    cnd_init(&rt->wake);
+    cnd_init(&rt->done);
+
+    // GL context moves to the render thread
+    glfwMakeContextCurrent(NULL);
+    if (thrd_create(&rt->thread, fs_render_thread, ctx) != thrd_success) {
+        assert(0 && "Error: failed to start render thread");
+    }
+    rt->running = 1;
+}
+
+static void fs_render_thread_stop(fs_Context *ctx)
 {
-    fs_Button btn;
+    fs_RenderThread *rt = &ctx->render;
+    if (!rt->running) {
+        return;
+    }
 
-    strncpy(btn.text, text, MAX_LEN);
-    fs_vec4_copy(btn.pos, pos);
-    fs_vector_add(ctx->buttons.button, &btn);
+    mtx_lock(&rt->lock);
+    rt->quit = 1;
+    cnd_signal(&rt->wake);
+    mtx_unlock(&rt->lock);
+    thrd_join(rt->thread, NULL);
 
-    fs_Atlas *atlas = &ctx->fonts[type];
-    pos[1] += (pos[3] + fs_text_height(atlas, text)) / 2.0f;
-    fs_add_text(ctx, (vec2){ pos[0] + pos[2] / 2.0f, pos[1] }, text, type, ctx->buttons.text_col, ALIGN_CENTER);
+    mtx_destroy(&rt->lock);
+    cnd_destroy(&rt->wake);
+    cnd_destroy(&rt->done);
+    rt->running = 0;
+    glfwMakeContextCurrent(ctx->window);
 }
 
-static void fs_add_inputbox(fs_Context *ctx, vec4 pos, int flag)
+// Hand built frame to render thread and take back the free one - lock-free triple buffer
+static void fs_publish_frame(fs_Context *ctx)
 {
-    // If inputbox is already used on current screen skip and return
-    if (ctx->inputbox.boxes[ctx->screen].box->size < ctx->inputbox.boxes[ctx->screen].count) {
-        ctx->inputbox.boxes[ctx->screen].box->size++;
-        return;
+    fs_RenderThread *rt = &ctx->render;
+
+    rt->write = atomic_exchange(&rt->ready, rt->write | FRAME_FRESH) & ~FRAME_FRESH;
+    mtx_lock(&rt->lock);
+    cnd_signal(&rt->wake);
+    mtx_unlock(&rt->lock);
+}
+#endif // FS_RENDER_THREAD
+
+static void fs_render_frame(fs_Context *ctx)
+{
+#ifdef FS_RENDER_THREAD
+    if (!ctx->render.running) {
+        fs_render_thread_start(ctx);
     }
+    fs_build_frame(ctx, &ctx->frames[ctx->render.write]);
+    fs_publish_frame(ctx);
+#else
+    fs_build_frame(ctx, &ctx->frames[0]);
+    fs_submit_frame(ctx, &ctx->frames[0]);
+    glfwSwapBuffers(ctx->window);
+#endif
+}
 
-    fs_Box box = { 0 };
-    fs_vec4_copy(box.pos, pos);
-    box.flag = flag;
-    fs_vector_add(ctx->inputbox.boxes[ctx->screen].box, &box);
+// Copy last presented frame to buffer of width * height * 3 bytes, rows bottom up
+static void fs_read_pixels(fs_Context *ctx, unsigned char *buffer)
+{
+#ifdef FS_RENDER_THREAD
+    if (ctx->render.running) {
+        fs_RenderThread *rt = &ctx->render;
+        mtx_lock(&rt->lock);
+        rt->readback = buffer;
+        cnd_signal(&rt->wake);
+        while (rt->readback) {
+            cnd_wait(&rt->done, &rt->lock);
+        }
+        mtx_unlock(&rt->lock);
+        return;
+    }
+#endif
+    fs_read_front(ctx, buffer);
+}
 
-    // Update y coordinate max depth
-    if (pos[1] + pos[3] > ctx->scroll.max) {
-        ctx->scroll.max = pos[1] + pos[3];
+// Render current state once more and hash it offscreen, 0 if the capture failed. Recording and replay hash alike.
+static uint64_t fs_frame_hash(fs_Context *ctx)
+{
+#ifdef FS_RENDER_THREAD
+    unsigned long captures = ctx->captures; // Read before the frame is published
+#endif
+    ctx->capture = 1;
+    fs_render_frame(ctx);
+#ifdef FS_RENDER_THREAD
+    fs_RenderThread *rt = &ctx->render;
+    mtx_lock(&rt->lock);
+    while (ctx->captures == captures) {
+        cnd_wait(&rt->done, &rt->lock);
     }
+    mtx_unlock(&rt->lock);
+#endif
+    return (ctx->capture_hash);
 }
 
-void fs_render_area_background(fs_Context *ctx)
+// Record input from now on, call after fs_init_context - the file is closed by fs_exit
+static int fs_record_start(fs_Context *ctx, const char *path)
 {
-    glUseProgram(ctx->area_shader.program);
-    glBindVertexArray(ctx->area_shader.vao);
+    fs_Replay *rp = &ctx->replay;
+    rp->fp = fopen(path, "wb");
+    if (rp->fp == NULL) {
+        fprintf(stderr, "Error: failed to create input recording %s\n", path);
+        return (0);
+    }
 
-    fs_Area *area = (fs_Area *)fs_vector_get(ctx->areas.area, ctx->areas.active);
-    glUniform2f(glGetUniformLocation(ctx->area_shader.program, "p0"), area->text_pos[0], area->text_pos[1] + area->text_pos[3]);
-    glUniform2f(glGetUniformLocation(ctx->area_shader.program, "p1"), area->text_pos[0] + area->text_pos[2], area->text_pos[1]);
-    glUniform4fv(glGetUniformLocation(ctx->area_shader.program, "color"), 1, (const GLfloat *)ctx->areas.col);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    int width, height;
+    glfwGetWindowSize(ctx->window, &width, &height);
+    fs_RecordHeader header = { RECORD_MAGIC, width, height, ctx->scale };
+    fwrite(&header, sizeof(header), 1, rp->fp);
+    rp->start   = glfwGetTime();
+    rp->last    = 0;
+    rp->records = 0;
+    return (1);
+}
 
-    glBindVertexArray(0);
-    glUseProgram(0);
+static void fs_record_stop(fs_Context *ctx)
+{
+    fs_Replay *rp = &ctx->replay;
+    if (rp->fp == NULL) {
+        return;
+    }
+    fs_Record rec  = { .kind = RECORD_END };
+    uint64_t  hash = fs_frame_hash(ctx);
+    fwrite(&rec, sizeof(rec), 1, rp->fp);
+    fwrite(&hash, sizeof(hash), 1, rp->fp);
+    if (fclose(rp->fp) != 0) {
+        fprintf(stderr, "Error: failed to write input recording\n");
+    }
+    rp->fp = NULL;
+    printf("Recorded %lu input events, final frame %016llx\n", rp->records, (unsigned long long)hash);
 }
 
-static void fs_render_rects(fs_Context *ctx)
+static void fs_replay_check_scale(fs_Context *ctx)
 {
-    glUseProgram(ctx->quad_shader.program);
-    glBindVertexArray(ctx->quad_shader.vao);
+    if (ctx->replay.scale != ctx->scale) {
+        fprintf(stderr, "Error: recording content scale %.2f differs from %.2f, frame hashes will not match\n", ctx->replay.scale, ctx->scale);
+    }
+}
 
-    // Draw rectangles
-    for (int i = 0; i < ctx->rects.rect->size; ++i) {
-        fs_Rect *rect = (fs_Rect *)fs_vector_get(ctx->rects.rect, i);
-        glUniform2f(glGetUniformLocation(ctx->quad_shader.program, "p0"), rect->pos[0], rect->pos[1] + rect->pos[3]);
-        glUniform2f(glGetUniformLocation(ctx->quad_shader.program, "p1"), rect->pos[0] + rect->pos[2], rect->pos[1]);
-        glUniform4fv(glGetUniformLocation(ctx->quad_shader.program, "color"), 1, (const GLfloat *)rect->col);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+// Load a recording to replay, call before fs_init_context to run headless in a hidden window
+static int fs_replay_load(fs_Context *ctx, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: failed to open input recording %s\n", path);
+        return (0);
     }
 
-    // Draw buttons
-    float ypos = ctx->my + ctx->scroll.offset / 2.0f;
-    for (int i = 0; i < ctx->buttons.button->size; ++i) {
-        fs_Button *btn = (fs_Button *)fs_vector_get(ctx->buttons.button, i);
-        glUniform2f(glGetUniformLocation(ctx->quad_shader.program, "p0"), btn->pos[0], btn->pos[1] + btn->pos[3]);
-        glUniform2f(glGetUniformLocation(ctx->quad_shader.program, "p1"), btn->pos[0] + btn->pos[2], btn->pos[1]);
+    fs_RecordHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != RECORD_MAGIC) {
+        fprintf(stderr, "Error: %s is not an input recording\n", path);
+        fclose(fp);
+        return (0);
+    }
 
-        if (ctx->mx > btn->pos[0] && ctx->mx < btn->pos[0] + btn->pos[2] && ypos > btn->pos[1] && ypos < btn->pos[1] + btn->pos[3]) {
-            glUniform4fv(glGetUniformLocation(ctx->quad_shader.program, "color"), 1, (const GLfloat *)ctx->buttons.hover_col);
-        } else {
-            glUniform4fv(glGetUniformLocation(ctx->quad_shader.program, "color"), 1, (const GLfloat *)ctx->buttons.normal_col);
+    fs_Replay *rp  = &ctx->replay;
+    size_t     cap = 256;
+    uint64_t   us  = 0;
+    fs_Record  rec;
+    rp->events     = malloc(cap * sizeof(fs_Event));
+    rp->events_num = 0;
+    assert(rp->events && "Error: failed to allocate replay events");
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        if (rec.kind == RECORD_END) {
+            if (fread(&rp->expected, sizeof(rp->expected), 1, fp) != 1) {
+                rp->expected = 0;
+            }
+            break;
         }
-
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        if (rec.kind > RECORD_END) {
+            fprintf(stderr, "Error: corrupt input recording %s\n", path);
+            break;
+        }
+        if (rp->events_num == cap) {
+            cap       *= 2;
+            rp->events = realloc(rp->events, cap * sizeof(fs_Event));
+            assert(rp->events && "Error: failed to allocate replay events");
+        }
+        us += rec.delta;
+        rp->events[rp->events_num++] = (fs_Event){ us / 1e6, rec.kind, rec.code, rec.action, rec.mods, rec.x, rec.y };
     }
+    fclose(fp);
+
+    rp->width  = header.width;
+    rp->height = header.height;
+    rp->scale  = header.scale;
+    rp->next   = 0;
+    rp->start  = 0;
+    rp->done   = 0;
+    if (ctx->window) {
+        glfwSetWindowSize(ctx->window, rp->width, rp->height);
+        fs_replay_check_scale(ctx);
+    }
+    return (1);
+}
 
-    // Draw inputboxes
-    for (int i = 0; i < ctx->inputbox.boxes[ctx->screen].box->size; ++i) {
-        fs_Box *box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, i);
-        glUniform2f(glGetUniformLocation(ctx->quad_shader.program, "p0"), box->pos[0], box->pos[1] + box->pos[3]);
-        glUniform2f(glGetUniformLocation(ctx->quad_shader.program, "p1"), box->pos[0] + box->pos[2], box->pos[1]);
+// Queue recorded events that are due, timing relative to the first call
+static void fs_replay_step(fs_Context *ctx)
+{
+    fs_Replay *rp = &ctx->replay;
+    if (rp->events == NULL || rp->done) {
+        return;
+    }
 
-        if (ctx->inputbox.boxes[ctx->screen].selected == i && ctx->double_click == GLFW_TRUE) {
-            glUniform4fv(glGetUniformLocation(ctx->quad_shader.program, "color"), 1, (const GLfloat *)ctx->inputbox.fg_col);
-        } else if (i == ctx->inputbox.boxes[ctx->screen].selected) {
-            glUniform4fv(glGetUniformLocation(ctx->quad_shader.program, "color"), 1, (const GLfloat *)ctx->inputbox.sel_col);
+    double now = glfwGetTime();
+    if (rp->start == 0) {
+        rp->start = now;
+    }
+    while (rp->next < rp->events_num && rp->start + rp->events[rp->next].time <= now) {
+        fs_Event ev = rp->events[rp->next++];
+        ev.time    += rp->start;
+        if (ev.kind == RECORD_RESIZE) {
+            glfwSetWindowSize(ctx->window, (int)ev.x, (int)ev.y);
         } else {
-            glUniform4fv(glGetUniformLocation(ctx->quad_shader.program, "color"), 1, (const GLfloat *)ctx->inputbox.bg_col);
+            fs_input_queue(ctx, &ev);
         }
-
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     }
-
-    glBindVertexArray(0);
-    glUseProgram(0);
 }
 
-void fs_render_text(fs_Context *ctx, FontType type)
+static void fs_replay_frame(fs_Context *ctx, double frame_time, double interval)
 {
-    glUseProgram(ctx->text_shader.program);
-    glBindVertexArray(ctx->text_shader.vao);
-
-    glUniform2f(glGetUniformLocation(ctx->text_shader.program, "res_atlas"), ctx->fonts[type].tex_width, ctx->fonts[type].tex_height);
-    glUniform1f(glGetUniformLocation(ctx->text_shader.program, "gamma"), ctx->fonts[type].gamma);
-    GLfloat vbi_data[MAX_INSTANCES * 3];
-    GLfloat vbi_colors[MAX_INSTANCES][3];
-    int     n = 0;
-
-    for (int i = 0; i < ctx->texts[type].text->size; ++i) {
-        fs_Text *text = (fs_Text *)fs_vector_get(ctx->texts[type].text, i);
-        float   xpos  = text->pos[0] - ctx->width / 2.0f;
-        float   ypos  = -text->pos[1] + ctx->height / 2.0f;
-
-        int previous = 0;
-        for (const unsigned char *c = (const unsigned char *)text; *c; ++c) {
-            if ((*c) == '\n') {
-                xpos  = text->pos[0] - ctx->width / 2.0f;
-                ypos -= ctx->fonts[type].line_height;
-                continue;
-            }
+    fs_Replay *rp = &ctx->replay;
+    if (rp->frames == rp->frames_cap) {
+        rp->frames_cap = rp->frames_cap ? rp->frames_cap * 2 : 1024;
+        rp->frame_time = realloc(rp->frame_time, rp->frames_cap * sizeof(float));
+        rp->interval   = realloc(rp->interval, rp->frames_cap * sizeof(float));
+        assert(rp->frame_time && rp->interval && "Error: failed to allocate replay frame timings");
+    }
+    rp->frame_time[rp->frames] = frame_time;
+    rp->interval[rp->frames]   = rp->frames > 0 ? interval : 0;
+    rp->frames++;
+}
 
-            signed long kerning = ctx->fonts[type].kerning_table[previous][*c];
-            vbi_data[3 * n + 0] = xpos + kerning;
-            vbi_data[3 * n + 1] = ypos;
-            vbi_data[3 * n + 2] = *c - 32.0f;
-            xpos               += ctx->fonts[type].glyphs[*c - 32].advance_x + kerning;
-            previous            = *c;
+static int fs_compare_float(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return ((x > y) - (x < y));
+}
 
-            memcpy(vbi_colors[n], text->col, 3 * sizeof(float));
-            ++n;
+// Frame time percentiles, input latency and final frame hash against the recording
+static void fs_replay_report(fs_Context *ctx)
+{
+    fs_Replay *rp = &ctx->replay;
+    printf("Replay: %zu of %zu events, %zu frames in %.2f s\n", rp->next, rp->events_num, rp->frames,
+           rp->start > 0 ? ctx->sched.last_present - rp->start : 0.0);
+
+    float *sorted = rp->frames > 0 ? malloc(rp->frames * sizeof(float)) : NULL;
+    if (sorted) {
+        double sum = 0, interval_max = 0;
+        for (size_t i = 0; i < rp->frames; ++i) {
+            sum          += rp->frame_time[i];
+            interval_max  = rp->interval[i] > interval_max ? rp->interval[i] : interval_max;
         }
+        memcpy(sorted, rp->frame_time, rp->frames * sizeof(float));
+        qsort(sorted, rp->frames, sizeof(float), fs_compare_float);
+        printf("Replay frame time: avg %.2f ms, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms, longest interval %.2f ms\n",
+               sum / rp->frames * 1000.0, sorted[rp->frames / 2] * 1000.0, sorted[rp->frames * 95 / 100] * 1000.0,
+               sorted[rp->frames * 99 / 100] * 1000.0, sorted[rp->frames - 1] * 1000.0, interval_max * 1000.0);
+        free(sorted);
     }
+    fs_input_report(ctx);
 
-    // Instance data
-    glBindBuffer(GL_ARRAY_BUFFER, ctx->text_shader.vbo_instance_data);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vbi_data), vbi_data, GL_STATIC_DRAW);
-
-    // Instance colors
-    glBindBuffer(GL_ARRAY_BUFFER, ctx->text_shader.vbo_instance_color);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vbi_colors), vbi_colors, GL_STATIC_DRAW);
-
-    // Render glyphs
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, ctx->fonts[type].tex_id);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, ctx->fonts[type].tex_metrics_id);
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n);
-
-    // Render finished
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
+    const char *result = rp->expected == 0 ? "not recorded" : (rp->hash == rp->expected ? "match" : "MISMATCH");
+    printf("Replay final frame %016llx, recorded %016llx: %s\n", (unsigned long long)rp->hash, (unsigned long long)rp->expected, result);
 }
 
-static void fs_render_ui(fs_Context *ctx)
+// All events fed and the UI idle - hash the final frame and close the window
+static void fs_replay_finish(fs_Context *ctx)
 {
-    glfwGetCursorPos(ctx->window, &ctx->mx, &ctx->my);
-
-    // Calculate srolling offset and speed
-    ctx->scroll.offset -= ctx->scroll.direction * ctx->scroll.speed;
+    fs_Replay *rp = &ctx->replay;
+    if (rp->events == NULL || rp->done) {
+        return;
+    }
+    rp->hash = fs_frame_hash(ctx);
+    rp->done = 1;
+    fs_replay_report(ctx);
+    glfwSetWindowShouldClose(ctx->window, GLFW_TRUE);
+}
 
-    // Scroll only downwards and no scroll if objects fit in window size
-    if (ctx->scroll.offset <= 0 || ctx->scroll.max <= ctx->height) {
-        ctx->scroll.offset = 0;
+static void fs_wait_events(fs_Context *ctx)
+{
+    FS_PROFILE_BEGIN("fs_wait_events");
+    double now     = glfwGetTime();
+    double timeout = -1; // Wait for input
+
+    // Pending redraw or next animation frame at frame rate cap
+    if (ctx->sched.dirty) {
+        timeout = 0;
+    } else if (ctx->sched.animating) {
+        timeout = ctx->sched.target_fps > 0 ? ctx->sched.last_present + 1.0 / ctx->sched.target_fps - now : 0;
+        timeout = timeout > 0 ? timeout : 0;
     }
 
-    if (ctx->scroll.direction != 0) {
-        ctx->scroll.speed *= ctx->scroll.factor; // Slowing down
-        if (ctx->scroll.speed < ACC_Y - LIMIT || ctx->scroll.speed > ACC_Y + LIMIT) {
-            ctx->scroll.speed = 0; // Stop moving
+    // Next recorded event, no waiting for input once all are fed
+    if (ctx->replay.events && !ctx->replay.done) {
+        fs_Replay *rp = &ctx->replay;
+        double     t  = rp->next < rp->events_num && rp->start > 0 ? rp->start + rp->events[rp->next].time - now : 0;
+        t             = t > 0 ? t : 0;
+        if (timeout < 0 || t < timeout) {
+            timeout = t;
         }
     }
 
-    fs_mat4_set_identity(ctx->transform);
-    fs_mat4_translate(ctx->transform, (vec3){ 0.0f, ctx->scroll.offset / ctx->height, 0.0f });
-
-    glUseProgram(ctx->quad_shader.program);
-    glUniform2f(glGetUniformLocation(ctx->quad_shader.program, "res_win"), ctx->width, ctx->height);
-    glUniformMatrix4fv(glGetUniformLocation(ctx->quad_shader.program, "transform"), 1, GL_FALSE, (const GLfloat *)ctx->transform);
-    glUseProgram(0);
-
-    glUseProgram(ctx->area_shader.program);
-    glUniform2f(glGetUniformLocation(ctx->area_shader.program, "res_win"), ctx->width, ctx->height);
-    glUniformMatrix4fv(glGetUniformLocation(ctx->area_shader.program, "transform"), 1, GL_FALSE, (const GLfloat *)ctx->transform);
-    glUseProgram(0);
-
-    glUseProgram(ctx->text_shader.program);
-    glUniform2f(glGetUniformLocation(ctx->text_shader.program, "res_win"), ctx->width, ctx->height);
-    glUniformMatrix4fv(glGetUniformLocation(ctx->text_shader.program, "transform"), 1, GL_FALSE, (const GLfloat *)ctx->transform);
-    glUseProgram(0);
-
-    // Update inputbox text and configure inputbox text position
-    for (int i = 0; i < ctx->inputbox.boxes[ctx->screen].box->size; ++i) {
-        fs_Box *box = (fs_Box *)fs_vector_get(ctx->inputbox.boxes[ctx->screen].box, i);
-        // Height of text should be fixed to avoid the text jumping up and down
-        float ypos = box->pos[1] + (box->pos[3] + ctx->fonts[BOX].glyphs['0' - 32].bitmap_height) / 2.0f;
-
-        if (ctx->inputbox.boxes[ctx->screen].selected == i && ctx->double_click == GLFW_TRUE) {
-            fs_add_text(ctx, (vec2){ box->pos[0] + PADDING, ypos }, box->text, BOX, ctx->inputbox.bg_col, ALIGN_LEFT);
-        } else {
-            fs_add_text(ctx, (vec2){ box->pos[0] + PADDING, ypos }, box->text, BOX, ctx->inputbox.fg_col, ALIGN_LEFT);
+    // Application timer
+    if (ctx->sched.timer > 0) {
+        double t = ctx->sched.timer - now;
+        t        = t > 0 ? t : 0;
+        if (timeout < 0 || t < timeout) {
+            timeout = t;
         }
     }
 
-    // Clear buffer
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // Render rectangles
-    fs_render_rects(ctx);
-
-    // Render texts
-    for (int i = 0; i < FONTS_NUM - 1; ++i) {
-        fs_render_text(ctx, i);
+    if (timeout < 0) {
+        glfwWaitEvents();
+    } else if (timeout == 0) {
+        glfwPollEvents();
+    } else {
+        glfwWaitEventsTimeout(timeout);
     }
-    fs_vector_reset(ctx->texts[BOX].text);
 
-    // Check and render areas
-    if (fs_check_area(ctx)) {
-        fs_render_area_background(ctx);
-        fs_render_text(ctx, HOVER);
-        fs_vector_reset(ctx->texts[HOVER].text);
+    if (ctx->sched.timer > 0 && glfwGetTime() >= ctx->sched.timer) {
+        ctx->sched.timer = 0;
     }
+    fs_input_drain(ctx);
+    FS_PROFILE_END("fs_wait_events");
+}
 
-    glfwSwapBuffers(ctx->window);
+static void fs_render_ui(fs_Context *ctx)
+{
+    FS_PROFILE_BEGIN("fs_render_ui");
+    fs_replay_step(ctx);
+    fs_input_drain(ctx);
+    fs_get_cursor(ctx);
+    ctx->sched.wakeups++;
+    fs_rebuild_step(ctx);
+
+    // Scroll animation runs on elapsed time, scheduler polls only while it moves
+    float offset = ctx->scroll.offset;
+    ctx->sched.animating = fs_scroll_update(ctx, glfwGetTime());
+    if (ctx->scroll.offset != offset) {
+        fs_invalidate(ctx);
+    }
 
-    // Poll events only if needed
-    if (ctx->scroll.speed > 0) {
-        glfwPollEvents();
+    // Redraw only if something changed
+    if (ctx->sched.dirty || ctx->sched.animating) {
+        // Hold the frame until the rate cap allows it, input arriving meanwhile is coalesced into it
+        double now      = glfwGetTime();
+        double deadline = ctx->sched.target_fps > 0 ? ctx->sched.last_present + 1.0 / ctx->sched.target_fps : 0;
+        while (now < deadline) {
+            glfwWaitEventsTimeout(deadline - now);
+            now = glfwGetTime();
+        }
+        fs_input_drain(ctx);
+        fs_get_cursor(ctx);
+        ctx->sched.animating |= fs_scroll_update(ctx, now);
+
+        fs_render_frame(ctx);
+        ctx->sched.dirty = 0;
+
+        // Frame pacing stats
+        double present        = glfwGetTime();
+        double interval       = present - ctx->sched.last_present;
+        ctx->sched.frame_time = present - now;
+        if (ctx->sched.frames > 0) {
+            ctx->sched.interval_avg = ctx->sched.frames > 1 ? ctx->sched.interval_avg * 0.9 + interval * 0.1 : interval;
+            if (interval > ctx->sched.interval_max) {
+                ctx->sched.interval_max = interval;
+            }
+        }
+        ctx->sched.last_present = present;
+        ctx->sched.frames++;
+        fs_input_presented(ctx, present);
+        if (ctx->replay.events) {
+            fs_replay_frame(ctx, ctx->sched.frame_time, interval);
+        }
     } else {
-        glfwWaitEvents();
+        ctx->sched.skipped++;
+        if (ctx->replay.events && ctx->replay.next == ctx->replay.events_num && ctx->input.head == ctx->input.tail) {
+            fs_replay_finish(ctx);
+        }
     }
+    FS_PROFILE_END("fs_render_ui");
+
+    fs_wait_events(ctx);
 }
 
 static void fs_clear_screen(fs_Context *ctx)
 {
     // Rectangles and quad shader
-    fs_vector_reset(ctx->rects.rect);
+    fs_rect_vector_clear(&ctx->rects.rect);
+    ctx->rects.geom.size = 0;
 
     // Buttons
-    fs_vector_reset(ctx->buttons.button);
-    ctx->buttons.clicked = NO_SIGNAL;
+    fs_button_vector_clear(&ctx->buttons.button);
+    ctx->buttons.geom.size = 0;
+    ctx->buttons.clicked   = NO_SIGNAL;
 
     // Inputboxes
     ctx->inputbox.boxes[ctx->screen].commited  = NO_SIGNAL;
-    ctx->inputbox.boxes[ctx->screen].count     = ctx->inputbox.boxes[ctx->screen].box->size;
-    ctx->inputbox.boxes[ctx->screen].box->size = 0;
+    ctx->inputbox.boxes[ctx->screen].count     = ctx->inputbox.boxes[ctx->screen].box.size;
+    ctx->inputbox.boxes[ctx->screen].box.size = 0;
+    ctx->inputbox.boxes[ctx->screen].geom.size = 0;
 
     // Clear texts
     for (int i = 0; i < FONTS_NUM; ++i) {
-        fs_vector_reset(ctx->texts[i].text);
+        fs_text_vector_clear(&ctx->texts[i].text);
+    }
+
+    // Clear layers, their textures are replaced when new layers get drawn
+    for (int i = 0; i < ctx->layers.num; ++i) {
+        fs_Layer *layer = &ctx->layers.layer[i];
+        fs_rect_vector_clear(&layer->rects.rect);
+        layer->rects.geom.size = 0;
+        for (int j = 0; j < FONTS_NUM; ++j) {
+            fs_text_vector_clear(&layer->texts[j].text);
+        }
     }
+    ctx->layers.num  = 0;
+    ctx->layers.open = NO_SIGNAL;
 
     // Clear areas
-    fs_vector_reset(ctx->areas.area);
-    ctx->areas.active = NO_SIGNAL;
+    fs_area_vector_clear(&ctx->areas.area);
+    ctx->areas.geom.size = 0;
+    ctx->areas.active    = NO_SIGNAL;
+
+    // Release all screen strings at once
+    fs_arena_reset(&ctx->arena);
+    fs_invalidate(ctx);
 }
 
-static void fs_change_screen(fs_Context *ctx, int scr)
+// Exchange live elements of the context with a parked scene
+static void fs_swap_scene(fs_Context *ctx, fs_Scene *scene)
 {
-    fs_clear_screen(ctx);
-    memset(&ctx->scroll, 0, sizeof(fs_Scroll));
-    ctx->inputbox.boxes[ctx->screen].selected = NO_SIGNAL;
-    ctx->screen                               = scr;
-    ctx->scroll.depth                         = ctx->height;
+    fs_Scene live;
+    live.areas   = ctx->areas;
+    live.buttons = ctx->buttons;
+    live.rects   = ctx->rects;
+    live.layers  = ctx->layers;
+    live.arena   = ctx->arena;
+    live.scroll  = ctx->scroll;
+    memcpy(live.texts, ctx->texts, sizeof(ctx->texts));
+
+    ctx->areas   = scene->areas;
+    ctx->buttons = scene->buttons;
+    ctx->rects   = scene->rects;
+    ctx->layers  = scene->layers;
+    ctx->arena   = scene->arena;
+    ctx->scroll  = scene->scroll;
+    memcpy(ctx->texts, scene->texts, sizeof(ctx->texts));
+    *scene = live;
 }
 
-void fs_init_font_atlas(fs_Context *ctx, FontType type, const char *font, float size)
+// Register screens up to num, new screens start empty. Returns 0 if out of memory.
+static int fs_reserve_screens(fs_Context *ctx, int num)
 {
-    FT_Library ft_lib = NULL;
-    FT_Face    face   = NULL;
-
-    if (FT_Init_FreeType(&ft_lib) != 0) {
-        printf("Error: failed to initialize FreeType library\n");
-        exit(1);
+    if (num <= ctx->screens_num) {
+        return (1);
+    }
+    fs_Screen **screens = realloc(ctx->screens, num * sizeof(fs_Screen *));
+    if (screens == NULL) {
+        return (0);
     }
+    ctx->screens  = screens;
+    fs_Boxes *boxes = realloc(ctx->inputbox.boxes, num * sizeof(fs_Boxes));
+    if (boxes == NULL) {
+        return (0);
+    }
+    ctx->inputbox.boxes = boxes;
 
-    if (FT_New_Face(ft_lib, font, 0, &face) != 0) {
-        printf("Error: failed to load font\n");
-        exit(1);
+    for (int i = ctx->screens_num; i < num; ++i) {
+        fs_Screen *screen = calloc(1, sizeof(fs_Screen));
+        if (screen == NULL) {
+            return (0);
+        }
+        fs_Scene *scene = &screen->scene;
+        fs_vec4_copy(scene->areas.col, ctx->areas.col);
+        fs_vec4_copy(scene->buttons.normal_col, ctx->buttons.normal_col);
+        fs_vec4_copy(scene->buttons.hover_col, ctx->buttons.hover_col);
+        fs_vec4_copy(scene->buttons.text_col, ctx->buttons.text_col);
+        scene->areas.active    = NO_SIGNAL;
+        scene->buttons.clicked = NO_SIGNAL;
+        scene->layers.open     = NO_SIGNAL;
+
+        memset(&boxes[i], 0, sizeof(fs_Boxes));
+        boxes[i].selected = NO_SIGNAL;
+        boxes[i].commited = NO_SIGNAL;
+
+        ctx->screens[i]  = screen;
+        ctx->screens_num = i + 1;
     }
+    return (1);
+}
 
-    fs_Atlas atlas = { 0 };
-    FT_Set_Char_Size(face, 0, size * 64, 144, 144);
-    FT_GlyphSlot slot = face->glyph;
-    atlas.line_height = face->size->metrics.height >> 6;
-    unsigned int roww = 0, rowh = 0;
+// Register a new screen, returns its index or NO_SIGNAL if out of memory
+static int fs_add_screen(fs_Context *ctx)
+{
+    return (fs_reserve_screens(ctx, ctx->screens_num + 1) ? ctx->screens_num - 1 : NO_SIGNAL);
+}
 
-    // First pass: calculate atlas dimensions
-    for (int i = 0; i < GLYPHS_NUM; ++i) {
-        if (FT_Load_Char(face, i + 32, FT_LOAD_RENDER | FT_LOAD_TARGET_LCD)) {
-            fprintf(stderr, "Error: loading character %c failed\n", i + 32);
-            continue;
-        }
+// Park elements of current screen and activate scr with the elements it had, unknown screens are registered
+static void fs_change_screen(fs_Context *ctx, int scr)
+{
+    assert(scr >= 0);
+    if (!fs_reserve_screens(ctx, scr + 1)) {
+        fprintf(stderr, "Error: out of memory, screen %d not added\n", scr);
+        return;
+    }
+    ctx->inputbox.boxes[ctx->screen].selected = NO_SIGNAL;
+    ctx->areas.active                         = NO_SIGNAL;
+    ctx->buttons.clicked                      = NO_SIGNAL;
+    ctx->layers.open                          = NO_SIGNAL;
+
+    // Scroll position is per screen, scroll mode is not
+    ScrollMode mode = ctx->scroll.mode;
+    fs_swap_scene(ctx, &ctx->screens[ctx->screen]->scene);
+    ctx->screen = scr;
+    fs_swap_scene(ctx, &ctx->screens[scr]->scene);
+    ctx->scroll.mode  = mode;
+    ctx->scroll.depth = ctx->height;
+
+    ctx->sched.hover_button = NO_SIGNAL;
+    ctx->sched.hover_area   = NO_SIGNAL;
+    fs_invalidate(ctx);
+}
 
-        unsigned int glyph_width = slot->bitmap.width;
-        if (roww + glyph_width + 1 >= MAX_WIDTH) {
-            atlas.tex_width   = atlas.tex_width > roww ? atlas.tex_width : roww;
-            atlas.tex_height += rowh;
-            roww              = 0;
-            rowh              = 0;
+static void fs_free_scene(fs_Scene *scene)
+{
+    fs_area_vector_free(&scene->areas.area);
+    fs_button_vector_free(&scene->buttons.button);
+    fs_rect_vector_free(&scene->rects.rect);
+    fs_geometry_free(&scene->areas.geom);
+    fs_geometry_free(&scene->buttons.geom);
+    fs_geometry_free(&scene->rects.geom);
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        fs_text_vector_free(&scene->texts[i].text);
+    }
+    for (int i = 0; i < LAYERS_NUM; ++i) {
+        fs_Layer *layer = &scene->layers.layer[i];
+        fs_rect_vector_free(&layer->rects.rect);
+        fs_geometry_free(&layer->rects.geom);
+        for (int j = 0; j < FONTS_NUM; ++j) {
+            fs_text_vector_free(&layer->texts[j].text);
         }
-        roww += glyph_width + 1;
-        rowh  = slot->bitmap.rows > rowh ? slot->bitmap.rows : rowh;
     }
+    fs_arena_free(&scene->arena);
+}
 
-    atlas.tex_width   = atlas.tex_width > roww ? atlas.tex_width : roww;
-    atlas.tex_height += rowh;
-
-    // Texture unit 0: font atlas. GL_RGB for subpixel rendering.
-    glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, &atlas.tex_id);
-    glBindTexture(GL_TEXTURE_2D, atlas.tex_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, atlas.tex_width, atlas.tex_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    // Paste all glyph bitmaps into the texture
-    int ox = 0, oy = 0;
-    rowh = 0;
+static size_t fs_arena_bytes(const fs_Arena *arena)
+{
+    size_t bytes = 0;
+    for (const fs_ArenaBlock *block = arena->first; block; block = block->next) {
+        bytes += sizeof(fs_ArenaBlock) + block->capacity;
+    }
+    return (bytes);
+}
 
-    for (int i = 0; i < GLYPHS_NUM; ++i) {
-        if (FT_Load_Char(face, i + 32, FT_LOAD_RENDER | FT_LOAD_TARGET_LCD)) {
-            fprintf(stderr, "Error: loading character %c failed\n", i + 32);
-            continue;
-        }
+inline static size_t fs_geometry_bytes(const fs_Geometry *geom)
+{
+    return (geom->capacity * 4 * sizeof(float));
+}
 
-        unsigned int glyph_width = slot->bitmap.width / 3.0; // Adjust for RGB subpixel data
-        if (ox + glyph_width + 1 >= MAX_WIDTH) {
-            oy  += rowh;
-            rowh = 0;
-            ox   = 0;
+// Heap bytes of the elements of a screen
+static size_t fs_scene_bytes(const fs_Scene *scene)
+{
+    size_t bytes = FS_VECTOR_BYTES(&scene->areas.area) + FS_VECTOR_BYTES(&scene->buttons.button) + FS_VECTOR_BYTES(&scene->rects.rect) +
+                   fs_geometry_bytes(&scene->areas.geom) + fs_geometry_bytes(&scene->buttons.geom) +
+                   fs_geometry_bytes(&scene->rects.geom) + fs_arena_bytes(&scene->arena);
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        bytes += FS_VECTOR_BYTES(&scene->texts[i].text);
+    }
+    for (int i = 0; i < LAYERS_NUM; ++i) {
+        const fs_Layer *layer = &scene->layers.layer[i];
+        bytes += FS_VECTOR_BYTES(&layer->rects.rect) + fs_geometry_bytes(&layer->rects.geom);
+        for (int j = 0; j < FONTS_NUM; ++j) {
+            bytes += FS_VECTOR_BYTES(&layer->texts[j].text);
         }
+    }
+    return (bytes);
+}
 
-        glTexSubImage2D(GL_TEXTURE_2D, 0, ox, oy, glyph_width, slot->bitmap.rows, GL_RGB, GL_UNSIGNED_BYTE, slot->bitmap.buffer);
+// Layer textures of a screen at the current content scale, RGBA8
+static size_t fs_scene_layer_bytes(fs_Context *ctx, const fs_Layers *layers)
+{
+    size_t bytes = 0;
+    for (int i = 0; i < layers->num; ++i) {
+        const float *bounds = layers->layer[i].bounds;
+        bytes += (size_t)lroundf(bounds[2] * ctx->scale) * (size_t)lroundf(bounds[3] * ctx->scale) * 4;
+    }
+    return (bytes);
+}
 
-        atlas.glyphs[i].advance_x     = slot->advance.x >> 6;
-        atlas.glyphs[i].bitmap_width  = glyph_width;
-        atlas.glyphs[i].bitmap_height = slot->bitmap.rows;
-        atlas.glyphs[i].bitmap_left   = slot->bitmap_left;
-        atlas.glyphs[i].bitmap_top    = slot->bitmap_top;
-        atlas.glyphs[i].offset_x      = ox;
-        atlas.glyphs[i].offset_y      = oy;
+// Memory held by the library per subsystem, main thread. GL side numbers are derived from main thread state,
+// except the streamed instance buffers, and FreeType's own allocations are not counted.
+static void fs_memory_usage(fs_Context *ctx, fs_Memory *mem)
+{
+    memset(mem, 0, sizeof(fs_Memory));
 
-        rowh = rowh > slot->bitmap.rows ? rowh : slot->bitmap.rows;
-        ox  += glyph_width + 1;
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        mem->gpu[MEM_FONTS] += ctx->fonts[i].gpu_memory;
+        mem->cpu[MEM_FONTS] += ctx->fonts[i].memory - ctx->fonts[i].gpu_memory;
     }
 
-    // Texture unit 1: glyph coordinates and metrics
-    GLfloat tex_data[GLYPHS_NUM * 4 * 2];
-    for (int i = 0; i < GLYPHS_NUM; i++) {
-        // The pixel coordinates of the bottom left corner, width and height of each glyph in the atlas
-        tex_data[4 * i + 0] = atlas.glyphs[i].offset_x / (float)atlas.tex_width;
-        tex_data[4 * i + 1] = atlas.glyphs[i].offset_y / (float)atlas.tex_height;
-        tex_data[4 * i + 2] = atlas.glyphs[i].bitmap_width / (float)atlas.tex_width;
-        tex_data[4 * i + 3] = atlas.glyphs[i].bitmap_height / (float)atlas.tex_height;
-        // Glyph metrics
-        tex_data[4 * GLYPHS_NUM + 4 * i + 0] = atlas.glyphs[i].bitmap_left / (float)atlas.tex_width;
-        tex_data[4 * GLYPHS_NUM + 4 * i + 1] = atlas.glyphs[i].bitmap_top / (float)atlas.tex_height;
-        tex_data[4 * GLYPHS_NUM + 4 * i + 2] = atlas.glyphs[i].bitmap_width / (float)atlas.tex_width;
-        tex_data[4 * GLYPHS_NUM + 4 * i + 3] = -atlas.glyphs[i].bitmap_height / (float)atlas.tex_height;
+    fs_RunCache *cache = &ctx->runs;
+    for (int i = 0; i < cache->used; ++i) {
+        fs_Run *run = &cache->runs[i];
+        size_t  len = strlen(run->text) + 1;
+        mem->cpu[MEM_RUNS] += len + (run->lines ? strlen(run->lines) + 1 : 0) + (run->glyphs ? len * sizeof(fs_RunGlyph) : 0);
     }
 
-    glActiveTexture(GL_TEXTURE1);
-    glGenTextures(1, &atlas.tex_metrics_id);
-    glBindTexture(GL_TEXTURE_2D, atlas.tex_metrics_id);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, GLYPHS_NUM, 2, 0, GL_RGBA, GL_FLOAT, tex_data);
+    // Active screen lives in the context, the others are parked in the registry
+    fs_Scene live = { .areas = ctx->areas, .buttons = ctx->buttons, .rects = ctx->rects, .layers = ctx->layers, .arena = ctx->arena };
+    memcpy(live.texts, ctx->texts, sizeof(ctx->texts));
+    mem->cpu[MEM_ELEMENTS] = sizeof(fs_Context) + ctx->screens_num * (sizeof(fs_Screen *) + sizeof(fs_Screen) + sizeof(fs_Boxes));
+    for (int i = 0; i < ctx->screens_num; ++i) {
+        fs_Scene *scene = i == ctx->screen ? &live : &ctx->screens[i]->scene;
+        fs_Boxes *boxes = &ctx->inputbox.boxes[i];
+        mem->cpu[MEM_ELEMENTS] += fs_scene_bytes(scene) + FS_VECTOR_BYTES(&boxes->box) + boxes->text_num * (sizeof(char *) + MAX_LEN + 1);
+        mem->gpu[MEM_LAYERS]   += fs_scene_layer_bytes(ctx, &scene->layers);
+    }
 
-    // Save kerning data if available - 0..255 to handle non-ASCII characters in text
-    signed long table[256][256] = { 0 };
-    if (FT_HAS_KERNING(face)) {
-        // Populate kerning pairs
-        for (int c1 = 0; c1 <= 255; c1++) {
-            for (int c2 = 0; c2 <= 255; c2++) {
-                FT_UInt   glyph_index1 = FT_Get_Char_Index(face, c1);
-                FT_UInt   glyph_index2 = FT_Get_Char_Index(face, c2);
-                FT_Vector kerning;
-                // Get kerning value
-                if (FT_Get_Kerning(face, glyph_index1, glyph_index2, FT_KERNING_DEFAULT, &kerning) != 0) {
-                    kerning.x = 0; // Error getting kerning for 'c1' and 'c2'
-                }
-                ;
-                // Store kerning adjustment (in 26.6 fixed-point format, convert to pixels)
-                table[c1][c2] = kerning.x >> 6;
+    mem->cpu[MEM_FRAMES] = fs_arena_bytes(&ctx->frame_arena);
+    for (int i = 0; i < FRAMES_NUM; ++i) {
+        fs_Frame *frame = &ctx->frames[i];
+        mem->cpu[MEM_FRAMES] += FS_VECTOR_BYTES(&frame->quads);
+        for (int j = 0; j < FONTS_NUM; ++j) {
+            mem->cpu[MEM_FRAMES] += FS_VECTOR_BYTES(&frame->glyphs[j]);
+        }
+        for (int j = 0; j < LAYERS_NUM; ++j) {
+            mem->cpu[MEM_FRAMES] += FS_VECTOR_BYTES(&frame->layers[j].quads);
+            for (int k = 0; k < FONTS_NUM; ++k) {
+                mem->cpu[MEM_FRAMES] += FS_VECTOR_BYTES(&frame->layers[j].glyphs[k]);
             }
         }
     }
+#ifdef FS_LAYOUT_THREADS
+    mem->cpu[MEM_FRAMES] += ctx->pool.offsets_cap * (sizeof(size_t) + sizeof(uint16_t)) + ctx->pool.tasks_cap * sizeof(fs_LayoutTask);
+#endif
 
-    memcpy(&ctx->fonts[type], &atlas, sizeof(fs_Atlas));
+    // Metrics buffer is counted with the fonts
+    mem->gpu[MEM_SHADERS] = ctx->quad_shader.stream_bytes + ctx->text_shader.stream_bytes + 8 * sizeof(GLfloat) +
+                            PALETTE_NUM * sizeof(vec4) + sizeof(fs_View);
+}
 
-    ctx->fonts[type].kerning_table = malloc(256 * sizeof(signed long *));
-    for (int i = 0; i < 256; ++i) {
-        ctx->fonts[type].kerning_table[i] = calloc(256, sizeof(signed long));
+// Print memory per subsystem, returns total bytes
+static size_t fs_memory_report(fs_Context *ctx)
+{
+    static const char *names[MEM_NUM] = { "Fonts", "Text runs", "Elements", "Frames", "Layers", "Shaders" };
+    fs_Memory          mem;
+    size_t             gpu = 0, cpu = 0;
+
+    fs_memory_usage(ctx, &mem);
+    for (int i = 0; i < MEM_NUM; ++i) {
+        printf("%-10s GPU %10zu bytes, CPU %10zu bytes\n", names[i], mem.gpu[i], mem.cpu[i]);
+        gpu += mem.gpu[i];
+        cpu += mem.cpu[i];
     }
+    printf("%-10s GPU %10zu bytes, CPU %10zu bytes\n", "Total", gpu, cpu);
+    return (gpu + cpu);
+}
 
-    for (int i = 0; i < 256; ++i) {
-        for (int j = 0; j < 256; ++j) {
-            ctx->fonts[type].kerning_table[i][j] = table[i][j];
-        }
+// Number of registered screens
+static int fs_screen_num(fs_Context *ctx)
+{
+    return (ctx->screens_num);
+}
+
+// Print compile or link log
+static void fs_shader_log(GLuint id, const char *what)
+{
+    GLint length = 0;
+    if (glIsProgram(id)) {
+        glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
+    } else {
+        glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+    }
+    char *log = calloc(length > 1 ? length : 1, 1);
+    assert(log);
+    if (glIsProgram(id)) {
+        glGetProgramInfoLog(id, length, NULL, log);
+    } else {
+        glGetShaderInfoLog(id, length, NULL, log);
+    }
+    fprintf(stderr, "Error: %s failed\n%s\n", what, log);
+    free(log);
+}
+
+static GLuint fs_compile_shader(GLenum type, const char *source, const char *what)
+{
+    GLint  result;
+    GLuint shader_ID = glCreateShader(type);
+    glShaderSource(shader_ID, 1, &source, NULL);
+    glCompileShader(shader_ID);
+    glGetShaderiv(shader_ID, GL_COMPILE_STATUS, &result);
+    if (!result) {
+        fs_shader_log(shader_ID, what);
+        glDeleteShader(shader_ID);
+        return (0);
     }
+    return (shader_ID);
+}
 
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft_lib);
+#ifdef FS_PROGRAM_BINARY
+// Driver and source changes give a new key, stale files are never read
+static uint64_t fs_program_key(const char *vertex_shader, const char *fragment_shader)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    hash          = fs_hash_str(hash, (const char *)glGetString(GL_RENDERER));
+    hash          = fs_hash_str(hash, (const char *)glGetString(GL_VERSION));
+    hash          = fs_hash_str(hash, vertex_shader);
+    return (fs_hash_str(hash, fragment_shader));
 }
 
-static void fs_init_fonts(fs_Context *ctx, fs_Fonts *fonts)
+static GLuint fs_load_program_binary(uint64_t key)
 {
-    for (FontType type = 0; type < FONTS_NUM; ++type) {
-        fs_init_font_atlas(ctx, type, fonts[type].path, fonts[type].size);
-        ctx->fonts[type].gamma = fonts[type].gamma;
+    char path[256];
+    snprintf(path, sizeof(path), FS_SHADER_CACHE "%016llx.bin", (unsigned long long)key);
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return (0);
     }
+
+    fs_ProgramHeader header;
+    GLuint           program = 0;
+    void            *binary  = NULL;
+    if (fread(&header, sizeof(header), 1, fp) == 1 && header.magic == PROGRAM_MAGIC && header.key == key &&
+        (binary = malloc(header.length)) != NULL && fread(binary, 1, header.length, fp) == header.length) {
+        GLint result;
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary, header.length);
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+        if (!result) {
+            glDeleteProgram(program); // Rejected by driver - link again and overwrite
+            program = 0;
+        }
+    }
+    free(binary);
+    fclose(fp);
+    return (program);
 }
 
-GLuint fs_load_shaders(const char *vertex_shader, const char *fragment_shader)
+static void fs_save_program_binary(GLuint program, uint64_t key)
 {
-    GLint  result1, result2;
-    GLuint vertex_shader_ID   = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragment_shader_ID = glCreateShader(GL_FRAGMENT_SHADER);
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    void *binary = length > 0 ? malloc(length) : NULL;
+    if (binary == NULL) {
+        return;
+    }
 
-    glShaderSource(vertex_shader_ID, 1, (const char **)&vertex_shader, NULL);
-    glCompileShader(vertex_shader_ID);
-    glGetShaderiv(vertex_shader_ID, GL_COMPILE_STATUS, &result1);
+    GLenum  format;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary);
+
+    char path[256];
+    snprintf(path, sizeof(path), FS_SHADER_CACHE "%016llx.bin", (unsigned long long)key);
+    FILE *fp = fopen(path, "wb");
+    if (fp && written > 0) {
+        fs_ProgramHeader header = { PROGRAM_MAGIC, format, key, written };
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(binary, 1, written, fp);
+    }
+    if (fp) {
+        fclose(fp); // Cache is optional, write errors are ignored
+    }
+    free(binary);
+}
+#endif // FS_PROGRAM_BINARY
 
-    glShaderSource(fragment_shader_ID, 1, (const char **)&fragment_shader, NULL);
-    glCompileShader(fragment_shader_ID);
-    glGetShaderiv(fragment_shader_ID, GL_COMPILE_STATUS, &result2);
+// Linked program from the binary cache, otherwise compiled and linked. Returns 0 on error.
+GLuint fs_load_shaders(const char *vertex_shader, const char *fragment_shader)
+{
+    FS_PROFILE_BEGIN("fs_load_shaders");
+#ifdef FS_PROGRAM_BINARY
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    uint64_t key     = formats > 0 ? fs_program_key(vertex_shader, fragment_shader) : 0;
+    GLuint   program = formats > 0 ? fs_load_program_binary(key) : 0;
+    if (program) {
+        FS_PROFILE_END("fs_load_shaders");
+        return (program);
+    }
+#endif
 
-    if (!result1 || !result2) {
+    GLuint vertex_shader_ID   = fs_compile_shader(GL_VERTEX_SHADER, vertex_shader, "vertex shader compile");
+    GLuint fragment_shader_ID = fs_compile_shader(GL_FRAGMENT_SHADER, fragment_shader, "fragment shader compile");
+    if (!vertex_shader_ID || !fragment_shader_ID) {
         glDeleteShader(vertex_shader_ID);
         glDeleteShader(fragment_shader_ID);
+        FS_PROFILE_END("fs_load_shaders");
         return (0);
     }
 
+    GLint  result;
     GLuint program_ID = glCreateProgram();
+#ifdef FS_PROGRAM_BINARY
+    if (formats > 0) {
+        glProgramParameteri(program_ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+#endif
     glAttachShader(program_ID, vertex_shader_ID);
     glAttachShader(program_ID, fragment_shader_ID);
     glLinkProgram(program_ID);
-    glGetProgramiv(program_ID, GL_LINK_STATUS, &result1);
+    glGetProgramiv(program_ID, GL_LINK_STATUS, &result);
 
-    if (result1 == GL_FALSE) {
-        glDeleteShader(vertex_shader_ID);
-        glDeleteShader(fragment_shader_ID);
+    glDeleteShader(vertex_shader_ID);
+    glDeleteShader(fragment_shader_ID);
+    if (result == GL_FALSE) {
+        fs_shader_log(program_ID, "program link");
+        glDeleteProgram(program_ID);
+        FS_PROFILE_END("fs_load_shaders");
         return (0);
     }
 
-    glDeleteShader(vertex_shader_ID);
-    glDeleteShader(fragment_shader_ID);
+#ifdef FS_PROGRAM_BINARY
+    if (formats > 0) {
+        fs_save_program_binary(program_ID, key);
+    }
+#endif
+    FS_PROFILE_END("fs_load_shaders");
     return (program_ID);
 }
 
@@ -1134,26 +5181,36 @@ void fs_init_context(fs_Context *ctx, char *title, int width, int height, vec4 c
     if (!glfwInit()) {
         assert(0 && "Error: failed to initialize GLFW\n");
     }
-    glfwSetErrorCallback(fs_error_callback);
+    glfwSetErrorCallback(FS_PROFILED(fs_error_callback));
 
     glfwWindowHint(GLFW_SAMPLES, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_TRUE); // Width and height are logical pixels
+    glfwWindowHint(GLFW_VISIBLE, ctx->replay.events ? GLFW_FALSE : GLFW_TRUE); // Replay runs headless
 
     ctx->window = glfwCreateWindow(width, height, title, NULL, NULL);
     assert(ctx->window);
-    ctx->width  = width;
-    ctx->height = height;
 
     glfwMakeContextCurrent(ctx->window);
     glfwSetWindowUserPointer(ctx->window, ctx);
-    glfwSetFramebufferSizeCallback(ctx->window, fs_resize_callback);
-    glfwSetKeyCallback(ctx->window, fs_key_callback);
-    glfwSetCharCallback(ctx->window, fs_char_callback);
-    glfwSetMouseButtonCallback(ctx->window, fs_button_callback);
-    glfwSetScrollCallback(ctx->window, fs_scroll_callback);
-    glfwSwapInterval(1);
+    if (ctx->replay.events) {
+        glfwSetWindowSize(ctx->window, ctx->replay.width, ctx->replay.height);
+    }
+    fs_update_scale(ctx);
+    if (ctx->replay.events) {
+        fs_replay_check_scale(ctx);
+    }
+    glfwSetFramebufferSizeCallback(ctx->window, FS_PROFILED(fs_resize_callback));
+    glfwSetKeyCallback(ctx->window, FS_PROFILED(fs_key_callback));
+    glfwSetCharCallback(ctx->window, FS_PROFILED(fs_char_callback));
+    glfwSetMouseButtonCallback(ctx->window, FS_PROFILED(fs_button_callback));
+    glfwSetScrollCallback(ctx->window, FS_PROFILED(fs_scroll_callback));
+    glfwSetCursorPosCallback(ctx->window, FS_PROFILED(fs_cursor_callback));
+    glfwSetWindowRefreshCallback(ctx->window, FS_PROFILED(fs_refresh_callback));
+    glfwSetWindowContentScaleCallback(ctx->window, FS_PROFILED(fs_scale_callback));
+    fs_set_swap_interval(ctx, SWAP_INTERVAL);
 
     // Initialize GLAD
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
@@ -1161,6 +5218,8 @@ void fs_init_context(fs_Context *ctx, char *title, int width, int height, vec4 c
         assert(0 && "Error: failed to initialize GLAD");
     }
 
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &ctx->max_texture);
+
     // GL states
     glEnable(GL_BLEND);
     glDisable(GL_CULL_FACE);
@@ -1168,51 +5227,81 @@ void fs_init_context(fs_Context *ctx, char *title, int width, int height, vec4 c
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     const char *vertex_quad = "#version 330 core\n"
-                              "uniform vec2 p0;\n"
-                              "uniform vec2 p1;\n"
-                              "uniform vec2 res_win;\n"
-                              "uniform mat4 transform;\n"
+                              "layout(location = 0) in vec4 rect;\n"
+                              "layout(location = 1) in vec4 color;\n"
+                              "layout(location = 2) in vec4 color2;\n"
+                              "layout(location = 3) in vec4 borderColor;\n"
+                              "layout(location = 4) in vec2 shape;\n" // radius, border
+                              FS_VIEW_BLOCK
+                              "out vec2 local;\n"
+                              "flat out vec2 size;\n"
+                              "flat out vec2 style;\n"
+                              "flat out vec4 fill0;\n"
+                              "flat out vec4 fill1;\n"
+                              "flat out vec4 edge;\n"
                               "void main()\n"
                               "{\n"
-                              "float x = gl_VertexID & 1;\n"
-                              "float y = (gl_VertexID >> 1) & 1;\n"
-                              "vec2 ndc_p0 = 2.0 * vec2(p0.x / res_win.x, (res_win.y - p0.y) / res_win.y) - 1.0;\n"
-                              "vec2 ndc_p1 = 2.0 * vec2(p1.x / res_win.x, (res_win.y - p1.y) / res_win.y) - 1.0;\n"
-                              "gl_Position = transform * vec4(ndc_p0 + vec2(x, y) * (ndc_p1 - ndc_p0), 0.0, 1.0);\n"
+                              "vec2 corner = vec2(gl_VertexID & 1, (gl_VertexID >> 1) & 1);\n"
+                              "local = corner * rect.zw;\n"
+                              "vec2 p = rect.xy + local;\n"
+                              "vec2 ndc = 2.0 * vec2(p.x / res_win.x, (res_win.y - p.y) / res_win.y) - 1.0;\n"
+                              "gl_Position = transform * vec4(ndc, 0.0, 1.0);\n"
+                              "size = rect.zw;\n"
+                              "style = shape;\n"
+                              "fill0 = color;\n"
+                              "fill1 = color2;\n"
+                              "edge = borderColor;\n"
                               "}\n";
 
+    // Signed distance to rounded rectangle gives corners, border and antialiasing over one framebuffer pixel
     const char *fragment_quad = "#version 330 core\n"
-                                "uniform vec4 color;\n"
+                                "in vec2 local;\n"
+                                "flat in vec2 size;\n"
+                                "flat in vec2 style;\n"
+                                "flat in vec4 fill0;\n"
+                                "flat in vec4 fill1;\n"
+                                "flat in vec4 edge;\n"
+                                FS_VIEW_BLOCK
                                 "out vec4 FragColor;\n"
                                 "void main()\n"
                                 "{\n"
-                                "FragColor = color;\n"
+                                "vec2 h = size * 0.5;\n"
+                                "float r = min(style.x, min(h.x, h.y));\n"
+                                "vec2 q = abs(local - h) - h + r;\n"
+                                "float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - r;\n"
+                                "vec4 fill = mix(fill0, fill1, local.y / max(size.y, 1.0));\n"
+                                "vec4 c = mix(edge, fill, clamp(0.5 - (d + style.y) * view_scale, 0.0, 1.0));\n"
+                                "FragColor = vec4(c.rgb, c.a * clamp(0.5 - d * view_scale, 0.0, 1.0));\n"
                                 "}\n";
 
     const char *vertex_text = "#version 330 core\n"
                               "layout(location = 0) in vec2 vertexPosition;\n"
-                              "layout(location = 1) in vec3 vertexInstance;\n"
-                              "layout(location = 2) in vec3 vertexColor;\n"
-                              "uniform sampler2D sampler_metrics;\n"
+                              "layout(location = 1) in ivec4 vertexInstance;\n" // x, y, glyph, color
+                              "layout(std140) uniform Palette { vec4 palette[" FS_STR(PALETTE_NUM) "]; };\n"
+                              "uniform samplerBuffer sampler_metrics;\n" // Two texels per glyph from metrics_base
+                              "uniform int metrics_base;\n"
+                              FS_VIEW_BLOCK
                               "uniform vec2 res_atlas;\n"
-                              "uniform vec2 res_win;\n"
-                              "uniform float glyphs_num;\n"
-                              "uniform mat4 transform;\n"
+                              "uniform float origin;\n"
+                              "uniform float scale;\n"
                               "out vec3 textColor;\n"
                               "out vec2 uv;\n"
                               "void main()\n"
                               "{\n"
-                              "vec4 q2 = texture(sampler_metrics, vec2((vertexInstance.z + 0.5) / glyphs_num, 0.75));\n"
+                              "int texel = metrics_base + vertexInstance.z * 2;\n"
+                              "vec4 q2 = texelFetch(sampler_metrics, texel + 1);\n"
                               "q2 *= vec4(res_atlas, res_atlas);\n"
                               "vec2 p = vertexPosition * q2.zw + q2.xy;\n"
-                              "p += vertexInstance.xy;\n"
+                              "p += vec2(vertexInstance.x, -(vertexInstance.y + origin));\n"
+                              "p = p / scale + vec2(-res_win.x, res_win.y) / 2.0;\n"
                               "p *= 2.0 / res_win;\n"
                               "gl_Position = transform * vec4(p, 0.0, 1.0);\n"
-                              "vec4 q = texture(sampler_metrics, vec2((vertexInstance.z + 0.5) / glyphs_num, 0.0));\n"
+                              "vec4 q = texelFetch(sampler_metrics, texel);\n"
                               "uv = q.xy + vertexPosition * q.zw;\n"
-                              "textColor = vertexColor;\n"
+                              "textColor = palette[vertexInstance.w].rgb;\n"
                               "}\n";
 
+#ifdef FS_TEXT_REFERENCE
     const char *fragment_text = "#version 330 core\n"
                                 "in vec2 uv;\n"
                                 "in vec3 textColor;\n"
@@ -1232,18 +5321,50 @@ void fs_init_context(fs_Context *ctx, char *title, int width, int height, vec4 c
                                 "float alpha = r * 0.3 + g * 0.6 + b * 0.1;\n"
                                 "FragColor = vec4(textColor, alpha);\n"
                                 "}\n";
+#else
+    // Gamma is baked into atlas. Glyphs on the framebuffer pixel grid fetch their texel unfiltered.
+    const char *fragment_text = "#version 330 core\n"
+                                "in vec2 uv;\n"
+                                "in vec3 textColor;\n"
+                                "uniform vec2 res_atlas;\n"
+                                "uniform sampler2D sampler_bitmap;\n"
+                                "uniform int aligned;\n"
+#ifdef FS_TEXT_DUAL_SOURCE
+                                "layout(location = 0, index = 0) out vec4 FragColor;\n"
+                                "layout(location = 0, index = 1) out vec4 Coverage;\n"
+#else
+                                "out vec4 FragColor;\n"
+#endif
+                                "void main()\n"
+                                "{\n"
+                                "vec3 c = aligned != 0 ? texelFetch(sampler_bitmap, ivec2(uv * res_atlas), 0).rgb : texture(sampler_bitmap, uv).rgb;\n"
+#ifdef FS_TEXT_DUAL_SOURCE
+                                "FragColor = vec4(textColor * c, 1.0);\n"
+                                "Coverage = vec4(c, 1.0);\n"
+#else
+                                "FragColor = vec4(textColor, dot(c, vec3(0.3, 0.6, 0.1)));\n"
+#endif
+                                "}\n";
+#endif
 
-    // Rectangle quad shader program
+    // Quad shader program - rectangles, buttons, inputboxes and hover area
     ctx->quad_shader.program = fs_load_shaders(vertex_quad, fragment_quad);
     assert(ctx->quad_shader.program);
     glGenVertexArrays(1, &ctx->quad_shader.vao);
     glBindVertexArray(ctx->quad_shader.vao);
 
-    // Area quad shader program
-    ctx->area_shader.program = fs_load_shaders(vertex_quad, fragment_quad);
-    assert(ctx->area_shader.program);
-    glGenVertexArrays(1, &ctx->area_shader.vao);
-    glBindVertexArray(ctx->area_shader.vao);
+    // Quad shader program - VBO for quad instances
+    glGenBuffers(1, &ctx->quad_shader.vbo_instance_data);
+    glBindBuffer(GL_ARRAY_BUFFER, ctx->quad_shader.vbo_instance_data);
+    GLint  quad_sizes[]   = { 4, 4, 4, 4, 2 };
+    size_t quad_offsets[] = { offsetof(fs_Quad, rect), offsetof(fs_Quad, style.col), offsetof(fs_Quad, style.col2),
+                              offsetof(fs_Quad, style.border_col), offsetof(fs_Quad, style.radius) };
+    for (int i = 0; i < 5; ++i) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, quad_sizes[i], GL_FLOAT, GL_FALSE, sizeof(fs_Quad), (void *)quad_offsets[i]);
+        glVertexAttribDivisor(i, 1); // Instanced vertex, advanced every instance
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     // Text shader program - VAO
     ctx->text_shader.program = fs_load_shaders(vertex_text, fragment_text);
@@ -1260,58 +5381,101 @@ void fs_init_context(fs_Context *ctx, char *title, int width, int height, vec4 c
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
     glVertexAttribDivisor(0, 0); // Not instanced: resets every instance
 
-    // Text shader program - VBO for glyph data
+    // Text shader program - VBO for glyph data: position, glyph index and color index in 8 bytes
     glGenBuffers(1, &ctx->text_shader.vbo_instance_data);
     glBindBuffer(GL_ARRAY_BUFFER, ctx->text_shader.vbo_instance_data);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
+    glVertexAttribIPointer(1, 4, GL_SHORT, sizeof(fs_Instance), (void *)0);
     glVertexAttribDivisor(1, 1); // Instanced vertex, advanced every instance
 
-    // Text shader program - VBO for color
-    glGenBuffers(1, &ctx->text_shader.vbo_instance_color);
-    glBindBuffer(GL_ARRAY_BUFFER, ctx->text_shader.vbo_instance_color);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    glVertexAttribDivisor(2, 1); // Instanced vertex, advanced every instance
+    // Text shader program - UBO for palette
+    glGenBuffers(1, &ctx->text_shader.ubo_palette);
+    glBindBuffer(GL_UNIFORM_BUFFER, ctx->text_shader.ubo_palette);
+    glBufferData(GL_UNIFORM_BUFFER, PALETTE_NUM * sizeof(vec4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, ctx->text_shader.ubo_palette);
+    glUniformBlockBinding(ctx->text_shader.program, glGetUniformBlockIndex(ctx->text_shader.program, "Palette"), 0);
 
     // Constant uniforms
     glUseProgram(ctx->text_shader.program);
     glUniform1i(glGetUniformLocation(ctx->text_shader.program, "sampler_bitmap"), 0);
     glUniform1i(glGetUniformLocation(ctx->text_shader.program, "sampler_metrics"), 1);
-    glUniform1f(glGetUniformLocation(ctx->text_shader.program, "glyphs_num"), GLYPHS_NUM);
     glUseProgram(0);
+    fs_gl_uniforms(&ctx->text_shader);
+
+    // Layer shader program - one textured quad per layer, corners from vertex ID
+    const char *vertex_layer = "#version 330 core\n"
+                               "uniform vec4 rect;\n"
+                               FS_VIEW_BLOCK
+                               "out vec2 uv;\n"
+                               "void main()\n"
+                               "{\n"
+                               "vec2 corner = vec2(gl_VertexID & 1, (gl_VertexID >> 1) & 1);\n"
+                               "vec2 p = rect.xy + corner * rect.zw;\n"
+                               "vec2 ndc = 2.0 * vec2(p.x / res_win.x, (res_win.y - p.y) / res_win.y) - 1.0;\n"
+                               "gl_Position = transform * vec4(ndc, 0.0, 1.0);\n"
+                               "uv = vec2(corner.x, 1.0 - corner.y);\n"
+                               "}\n";
+
+    const char *fragment_layer = "#version 330 core\n"
+                                 "in vec2 uv;\n"
+                                 "uniform sampler2D sampler_layer;\n"
+                                 "out vec4 FragColor;\n"
+                                 "void main()\n"
+                                 "{\n"
+                                 "FragColor = texture(sampler_layer, uv);\n"
+                                 "}\n";
+
+    ctx->layer_shader.program = fs_load_shaders(vertex_layer, fragment_layer);
+    assert(ctx->layer_shader.program);
+    fs_gl_uniforms(&ctx->layer_shader);
+    glGenVertexArrays(1, &ctx->layer_shader.vao);
+
+    // View block on binding 1 for all programs, palette is on 0
+    glGenBuffers(1, &ctx->ubo_view);
+    glBindBuffer(GL_UNIFORM_BUFFER, ctx->ubo_view);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(fs_View), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, ctx->ubo_view);
+    GLuint programs[] = { ctx->quad_shader.program, ctx->text_shader.program, ctx->layer_shader.program };
+    for (int i = 0; i < 3; ++i) {
+        glUniformBlockBinding(programs[i], glGetUniformBlockIndex(programs[i], "View"), 1);
+    }
+    ctx->layers.open = NO_SIGNAL;
+    fs_run_cache_init(&ctx->runs);
+
+    // Scheduler - first frame is always drawn
+    ctx->sched.target_fps   = TARGET_FPS;
+    ctx->sched.hover_button = NO_SIGNAL;
+    ctx->sched.hover_area   = NO_SIGNAL;
+    fs_invalidate(ctx);
+    ctx->swap_applied = NO_SIGNAL;
+
+#ifdef FS_LAYOUT_THREADS
+    fs_pool_start(&ctx->pool);
+#endif
 
     // Set windows background color
     glClearColor(colors[0][0], colors[0][1], colors[0][2], colors[0][3]);
 
-    // Initialize areas
-    ctx->areas.area   = fs_vector_init(sizeof(fs_Area), VEC_INIT_CAP);
+    // Initialize areas - vectors start with inline storage of zeroed context
     ctx->areas.active = NO_SIGNAL;
     fs_vec4_copy(ctx->areas.col, colors[1]);
 
     // Init and set inputbox defaults
-    for (int i = 0; i < SCREEN_NUM; ++i) {
-        ctx->inputbox.boxes[i].box      = fs_vector_init(sizeof(fs_Box), VEC_INIT_CAP);
-        ctx->inputbox.boxes[i].selected = NO_SIGNAL;
-        ctx->inputbox.boxes[i].commited = NO_SIGNAL;
-    }
     fs_vec4_copy(ctx->inputbox.bg_col, colors[2]);
     fs_vec4_copy(ctx->inputbox.sel_col, colors[3]);
     fs_vec4_copy(ctx->inputbox.fg_col, colors[4]);
 
     // Init and set button defaults
-    ctx->buttons.button  = fs_vector_init(sizeof(fs_Button), VEC_INIT_CAP);
     ctx->buttons.clicked = NO_SIGNAL;
     fs_vec4_copy(ctx->buttons.normal_col, colors[5]);
     fs_vec4_copy(ctx->buttons.hover_col, colors[6]);
     fs_vec4_copy(ctx->buttons.text_col, colors[7]);
 
-    // Init rectangles
-    ctx->rects.rect = fs_vector_init(sizeof(fs_Rect), VEC_INIT_CAP);
-
-    // Init texts
-    for (int i = 0; i < FONTS_NUM; ++i) {
-        ctx->texts[i].text = fs_vector_init(sizeof(fs_Text), VEC_INIT_CAP);
+    // Screen 0 is active, more are registered by fs_add_screen or fs_change_screen
+    if (!fs_reserve_screens(ctx, 1)) {
+        assert(0 && "Error: out of memory");
     }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -1320,37 +5484,101 @@ void fs_init_context(fs_Context *ctx, char *title, int width, int height, vec4 c
 
 static void fs_exit(fs_Context *ctx)
 {
-    // Free vectors
-    fs_vector_free(ctx->areas.area);
-    fs_vector_free(ctx->buttons.button);
-    fs_vector_free(ctx->rects.rect);
+    // Recording ends with the final frame hash, a replay closed by a recorded key reports here
+    fs_record_stop(ctx);
+    fs_replay_finish(ctx);
+    free(ctx->replay.events);
+    free(ctx->replay.frame_time);
+    free(ctx->replay.interval);
+
+#ifdef FS_RENDER_THREAD
+    // GL context returns to this thread
+    fs_render_thread_stop(ctx);
+#endif
+#ifdef FS_LAYOUT_THREADS
+    fs_pool_stop(&ctx->pool);
+#endif
 
-    for (int i = 0; i < FONTS_NUM; ++i) {
-        fs_vector_free(ctx->texts[i].text);
+    // Park active screen, then free elements and layer textures of all screens
+    fs_swap_scene(ctx, &ctx->screens[ctx->screen]->scene);
+    for (int i = 0; i < ctx->screens_num; ++i) {
+        fs_Screen *screen = ctx->screens[i];
+        fs_free_scene(&screen->scene);
+        for (int j = 0; j < LAYERS_NUM; ++j) {
+            glDeleteFramebuffers(1, &screen->layer_tex[j].fbo);
+            fs_gl_delete_texture(ctx, screen->layer_tex[j].tex_id);
+        }
+
+        fs_Boxes *boxes = &ctx->inputbox.boxes[i];
+        fs_box_vector_free(&boxes->box);
+        fs_geometry_free(&boxes->geom);
+        for (int j = 0; j < boxes->text_num; ++j) {
+            free(boxes->text[j]);
+        }
+        free(boxes->text);
+        free(screen);
+    }
+    free(ctx->screens);
+    free(ctx->inputbox.boxes);
+    fs_run_cache_free(&ctx->runs);
+
+    for (int i = 0; i < FRAMES_NUM; ++i) {
+        fs_quad_vector_free(&ctx->frames[i].quads);
+        for (int j = 0; j < FONTS_NUM; ++j) {
+            fs_instance_vector_free(&ctx->frames[i].glyphs[j]);
+        }
+        for (int j = 0; j < LAYERS_NUM; ++j) {
+            fs_quad_vector_free(&ctx->frames[i].layers[j].quads);
+            for (int k = 0; k < FONTS_NUM; ++k) {
+                fs_instance_vector_free(&ctx->frames[i].layers[j].glyphs[k]);
+            }
+        }
+    }
 
-        for (size_t j = 0; j < GLYPHS_NUM; ++j) {
-            free(ctx->fonts[i].kerning_table[j]);
+    // Rebuild in flight and atlases not yet uploaded
+#ifdef FS_THREADS
+    if (ctx->rebuild.running && ctx->rebuild.threaded) {
+        thrd_join(ctx->rebuild.thread, NULL);
+    }
+#endif
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        if (ctx->rebuild.images[i]) {
+            fs_free_atlas(&ctx->rebuild.images[i]->atlas);
+            fs_free_atlas_image(ctx->rebuild.images[i]);
+        }
+        if (ctx->atlas_pending[i]) {
+            fs_free_atlas_image(ctx->atlas_pending[i]);
         }
-        free(ctx->fonts[i].kerning_table);
+        fs_gl_delete_texture(ctx, ctx->atlas_tex[i].tex_id);
+        fs_free_glyph_log(ctx->atlas_tex[i].log);
     }
+    fs_gl_delete_texture(ctx, ctx->text_shader.tex_metrics);
+    glDeleteBuffers(1, &ctx->text_shader.tbo_metrics);
 
-    for (int i = 0; i < SCREEN_NUM; ++i) {
-        fs_vector_free(ctx->inputbox.boxes[i].box);
+    for (int i = 0; i < FONTS_NUM; ++i) {
+        fs_text_vector_free(&ctx->texts[i].text); // Inputbox and hover texts stay live
+        fs_free_atlas(&ctx->fonts[i]);
     }
+    fs_arena_free(&ctx->frame_arena);
 
     // Free shader programs
+    glDeleteBuffers(1, &ctx->quad_shader.vbo_instance_data);
     glDeleteVertexArrays(1, &ctx->quad_shader.vao);
     glDeleteProgram(ctx->quad_shader.program);
 
-    glDeleteVertexArrays(1, &ctx->area_shader.vao);
-    glDeleteProgram(ctx->area_shader.program);
-
     glDeleteBuffers(1, &ctx->text_shader.vbo_quad);
     glDeleteBuffers(1, &ctx->text_shader.vbo_instance_data);
-    glDeleteBuffers(1, &ctx->text_shader.vbo_instance_color);
+    glDeleteBuffers(1, &ctx->text_shader.ubo_palette);
     glDeleteVertexArrays(1, &ctx->text_shader.vao);
     glDeleteProgram(ctx->text_shader.program);
 
+    glDeleteVertexArrays(1, &ctx->layer_shader.vao);
+    glDeleteProgram(ctx->layer_shader.program);
+    glDeleteBuffers(1, &ctx->ubo_view);
+
+#ifdef FS_PROFILE
+    fs_profile_close();
+#endif
     glfwTerminate();
     free(ctx);
 }